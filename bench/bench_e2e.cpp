@@ -0,0 +1,262 @@
+// End-to-end cost of the .bif workloads in bench/workloads: transpile time,
+// g++ time, binary size and run time, each the median over the repeats. The
+// report is JSON with one workload per line, so two runs can be diffed
+// directly or checked with --compare.
+//
+//   bench_e2e [repeats] [workload-dir] > report.json
+//   bench_e2e --compare base.json new.json [tolerance-percent]
+//
+// A workload whose first line is `# stdin: N` reads N generated lines of
+// integers on stdin. --compare exits with 1 when any metric of any workload
+// grew by more than the tolerance (default 10%); times below 1 ms are noise.
+
+#define BIFC_NO_MAIN
+#include "../tools/bifc.cpp"
+
+#include <chrono>
+#include <cstdlib>
+
+namespace {
+
+const fs::path kRepoRoot = fs::path(__FILE__).parent_path().parent_path();
+
+struct Workload {
+    std::string name;
+    fs::path path;
+    size_t stdin_lines = 0;
+};
+
+struct Metrics {
+    std::string name;
+    size_t lines = 0;
+    double transpile_ms = 0.0;
+    double gxx_ms = 0.0;
+    double binary_bytes = 0.0;
+    double run_ms = 0.0;
+};
+
+template <typename Fn>
+double median_ms(int repeats, Fn&& fn) {
+    std::vector<double> samples;
+    for (int r = 0; r < repeats; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        samples.push_back(elapsed.count());
+    }
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2];
+}
+
+std::vector<Workload> find_workloads(const fs::path& dir) {
+    std::vector<Workload> workloads;
+    for (const auto& entry : fs::directory_iterator(dir)) {
+        if (entry.path().extension() != ".bif") {
+            continue;
+        }
+        Workload workload{entry.path().stem().string(), entry.path()};
+        std::ifstream in(entry.path());
+        std::string first;
+        std::getline(in, first);
+        if (first.rfind("# stdin:", 0) == 0) {
+            workload.stdin_lines = std::strtoull(first.c_str() + 8, nullptr, 10);
+        }
+        workloads.push_back(workload);
+    }
+    std::sort(workloads.begin(), workloads.end(), [](const Workload& a, const Workload& b) {
+        return a.name < b.name;
+    });
+    return workloads;
+}
+
+bool measure(const Workload& workload, int repeats, const fs::path& work_dir, const fs::path& library_dir,
+             Metrics& metrics) {
+    SourceBuffer source;
+    if (!source.open(workload.path)) {
+        std::cerr << workload.name << ": cannot read " << workload.path.string() << std::endl;
+        return false;
+    }
+    std::vector<std::string_view> lines = split_lines(source.text());
+    metrics.name = workload.name;
+    metrics.lines = lines.size();
+
+    TranspileResult result;
+    try {
+        metrics.transpile_ms = median_ms(repeats, [&]() {
+            result = transpile_bif(lines);
+        });
+    } catch (const ParseError& parse_error) {
+        std::cerr << workload.name << ": " << parse_error.message << std::endl;
+        return false;
+    }
+
+    fs::path cpp_path = work_dir / (workload.name + ".cpp");
+    fs::path exe_path = work_dir / (workload.name + ".exe");
+    fs::path log_path = work_dir / (workload.name + ".log");
+    write_cpp(cpp_path, result);
+
+    // Built the way bifc builds: warm PCH, and libbif.a when the program
+    // imports a library.
+    BuildCache cache(BuildCache::default_root(), BuildCache::default_max_bytes());
+    fs::path pch_header = cache.prelude_pch(result.imports, kRepoRoot);
+    fs::path library;
+    bool needs_library = std::any_of(result.imports.begin(), result.imports.end(), [](const std::string& name) {
+        return library_sources().count(name) > 0;
+    });
+    if (needs_library) {
+        fs::path prebuilt = library_dir / "libbif.a";
+        library = fs::exists(prebuilt) ? prebuilt : cache.library(kRepoRoot);
+    }
+    std::vector<std::string> flags = compile_flags();
+    if (!library.empty()) {
+        flags.push_back("-flto");
+    }
+    int compile_result = 0;
+    metrics.gxx_ms = median_ms(repeats, [&]() {
+        compile_result |= compile_cpp(flags, cpp_path, exe_path, kRepoRoot, pch_header, library, log_path);
+    });
+    if (compile_result != 0) {
+        std::cerr << workload.name << ": compilation failed" << std::endl << read_file_text(log_path);
+        return false;
+    }
+    metrics.binary_bytes = static_cast<double>(fs::file_size(exe_path));
+
+    fs::path input_path = work_dir / (workload.name + ".in");
+    {
+        std::ofstream input(input_path, std::ios::binary);
+        for (size_t i = 0; i < workload.stdin_lines; ++i) {
+            input << (i * 7919) % 1000003 << '\n';
+        }
+    }
+    int run_result = 0;
+    metrics.run_ms = median_ms(repeats, [&]() {
+        run_result |= run_process(exe_path.string(), {}, input_path, kNullDevice);
+    });
+    if (run_result != 0) {
+        std::cerr << workload.name << ": program failed" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+std::string json_escape(const std::string& text) {
+    std::string out;
+    for (char ch : text) {
+        if (ch == '"' || ch == '\\') {
+            out.push_back('\\');
+        }
+        out.push_back(ch);
+    }
+    return out;
+}
+
+// Reads back a report written by this tool: one workload object per line.
+std::vector<Metrics> read_report(const fs::path& path) {
+    std::vector<Metrics> report;
+    std::ifstream in(path);
+    std::string line;
+    auto number = [&](const char* key) {
+        size_t at = line.find(std::string("\"") + key + "\": ");
+        return at == std::string::npos ? 0.0 : std::atof(line.c_str() + at + std::strlen(key) + 4);
+    };
+    while (std::getline(in, line)) {
+        size_t at = line.find("\"name\": \"");
+        if (at == std::string::npos) {
+            continue;
+        }
+        Metrics metrics;
+        size_t start = at + 9;
+        metrics.name = line.substr(start, line.find('"', start) - start);
+        metrics.lines = static_cast<size_t>(number("lines"));
+        metrics.transpile_ms = number("transpile_ms");
+        metrics.gxx_ms = number("gxx_ms");
+        metrics.binary_bytes = number("binary_bytes");
+        metrics.run_ms = number("run_ms");
+        report.push_back(metrics);
+    }
+    return report;
+}
+
+int compare_reports(const fs::path& base_path, const fs::path& new_path, double tolerance) {
+    std::vector<Metrics> base = read_report(base_path);
+    std::vector<Metrics> current = read_report(new_path);
+    if (base.empty() || current.empty()) {
+        std::cerr << "No workloads in " << (base.empty() ? base_path : new_path).string() << std::endl;
+        return 2;
+    }
+    int regressions = 0;
+    std::printf("%-22s %-12s %14s %14s %8s\n", "workload", "metric", "base", "new", "change");
+    for (const Metrics& now : current) {
+        auto old = std::find_if(base.begin(), base.end(), [&](const Metrics& m) { return m.name == now.name; });
+        if (old == base.end()) {
+            std::printf("%-22s (new workload)\n", now.name.c_str());
+            continue;
+        }
+        const std::pair<const char*, double Metrics::*> fields[] = {
+            {"transpile_ms", &Metrics::transpile_ms},
+            {"gxx_ms", &Metrics::gxx_ms},
+            {"binary_bytes", &Metrics::binary_bytes},
+            {"run_ms", &Metrics::run_ms},
+        };
+        for (const auto& field : fields) {
+            double before = (*old).*field.second;
+            double after = now.*field.second;
+            double change = before > 0.0 ? (after - before) * 100.0 / before : 0.0;
+            bool is_time = field.second != &Metrics::binary_bytes;
+            bool regressed = change > tolerance && !(is_time && after - before < 1.0);
+            regressions += regressed;
+            std::printf("%-22s %-12s %14.3f %14.3f %+7.1f%%%s\n", now.name.c_str(), field.first, before, after,
+                        change, regressed ? "  REGRESSION" : "");
+        }
+    }
+    std::printf("%d regression(s) over %.1f%%\n", regressions, tolerance);
+    return regressions > 0 ? 1 : 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc > 1 && std::string(argv[1]) == "--compare") {
+        if (argc < 4) {
+            std::cerr << "usage: bench_e2e --compare base.json new.json [tolerance-percent]" << std::endl;
+            return 2;
+        }
+        return compare_reports(argv[2], argv[3], argc > 4 ? std::atof(argv[4]) : 10.0);
+    }
+
+    int repeats = (argc > 1) ? std::max(1, std::atoi(argv[1])) : 5;
+    fs::path dir = (argc > 2) ? fs::path(argv[2]) : kRepoRoot / "bench" / "workloads";
+    fs::path library_dir = fs::absolute(argv[0]).parent_path();
+    fs::path work_dir = fs::temp_directory_path() / ("bench_e2e" + temp_suffix());
+    fs::create_directories(work_dir);
+
+    std::vector<Metrics> results;
+    bool ok = true;
+    for (const Workload& workload : find_workloads(dir)) {
+        std::cerr << workload.name << "..." << std::endl;
+        Metrics metrics;
+        if (measure(workload, repeats, work_dir, library_dir, metrics)) {
+            results.push_back(metrics);
+        } else {
+            ok = false;
+        }
+    }
+    std::error_code ec;
+    fs::remove_all(work_dir, ec);
+
+    std::printf("{\"repeats\": %d, \"compiler\": \"%s\", \"flags\": \"", repeats,
+                json_escape(compiler_identity()).c_str());
+    for (size_t i = 0; i < compile_flags().size(); ++i) {
+        std::printf("%s%s", i > 0 ? " " : "", compile_flags()[i].c_str());
+    }
+    std::printf("\", \"workloads\": [\n");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Metrics& m = results[i];
+        std::printf("  {\"name\": \"%s\", \"lines\": %zu, \"transpile_ms\": %.3f, \"gxx_ms\": %.1f, "
+                    "\"binary_bytes\": %.0f, \"run_ms\": %.1f}%s\n",
+                    json_escape(m.name).c_str(), m.lines, m.transpile_ms, m.gxx_ms, m.binary_bytes, m.run_ms,
+                    i + 1 < results.size() ? "," : "");
+    }
+    std::printf("]}\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,113 @@
+// Cost of expression translation, reported separately for two inputs built
+// from the same corpus: the previous seven-pass rewriter (legacy_normalize.h)
+// on bare expressions, and transpile_bif on a program that prints each of
+// them (parse, typing, folding and emission of whole statements). The inputs
+// differ, so the two times are not a speedup; each is meant to be compared
+// with itself across commits.
+//
+//   bench_normalize [megabytes] [repeats]
+
+#define BIFC_NO_MAIN
+#include "../tools/bifc.cpp"
+
+#include "legacy_normalize.h"
+
+#include <chrono>
+#include <cstdlib>
+
+namespace {
+
+const std::vector<std::string> kTemplates = {
+    "(x <= y) and z and not(w)",
+    "1488 / 4328",
+    "x > 5",
+    "x - 1",
+    "input(\"Name: \")",
+    "BIFMath.sqrt(x * x + y * y) / 2",
+    "and(a > 1, b < 2, c == \"and(\")",
+    "or(not(done), count >= 10)",
+    "sqrt(9) + pow(2, 8) * 3",
+    "\"a # string / with \\\" quotes\" + name",
+    "True or False and None",
+    "counter + 1",
+    "BIFitertools.range(0, n, 2)",
+    "total / (items + 1.5e3)",
+};
+
+// Declares every variable the templates use from input, so nothing is
+// folded away as a constant.
+constexpr const char* kProgramHeader = R"(import BIFMath
+import BIFitertools
+from BIFMath import sqrt
+from BIFMath import pow
+x = int(input())
+y = int(input())
+z = int(input())
+w = int(input())
+a = int(input())
+b = int(input())
+c = input()
+done = x > y
+count = int(input())
+n = int(input())
+items = int(input())
+total = float(input())
+name = input()
+counter = int(input())
+)";
+
+template <typename Fn>
+double best_seconds(int repeats, Fn&& fn) {
+    double best = 0.0;
+    for (int r = 0; r < repeats; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (r == 0 || elapsed.count() < best) {
+            best = elapsed.count();
+        }
+    }
+    return best;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    double megabytes = (argc > 1) ? std::atof(argv[1]) : 16.0;
+    int repeats = (argc > 2) ? std::atoi(argv[2]) : 5;
+
+    std::vector<std::string> corpus;
+    size_t total_bytes = 0;
+    size_t target = static_cast<size_t>(megabytes * 1024.0 * 1024.0);
+    for (size_t i = 0; total_bytes < target; ++i) {
+        corpus.push_back(kTemplates[i % kTemplates.size()]);
+        total_bytes += corpus.back().size();
+    }
+
+    std::vector<std::string> modules = {"BIFMath", "BIFitertools"};
+    std::unordered_map<std::string, std::string> imported = {{"sqrt", "BIFMath"}, {"pow", "BIFMath"}};
+
+    std::string source = kProgramHeader;
+    for (const auto& expr : corpus) {
+        source += "print(" + expr + ")\n";
+    }
+    std::vector<std::string_view> lines = split_lines(source);
+
+    size_t sink = 0;
+    double legacy_seconds = best_seconds(repeats, [&]() {
+        for (const auto& expr : corpus) {
+            sink += legacy::normalize_expression(expr, modules, imported).size();
+        }
+    });
+    double bifc_seconds = best_seconds(repeats, [&]() {
+        sink += transpile_bif(lines).body.size();
+    });
+
+    double mb = static_cast<double>(total_bytes) / (1024.0 * 1024.0);
+    double source_mb = static_cast<double>(source.size()) / (1024.0 * 1024.0);
+    std::printf("corpus: %zu expressions, %.2f MB\n", corpus.size(), mb);
+    std::printf("legacy passes, bare expressions:   %9.1f ms\n", legacy_seconds * 1e3);
+    std::printf("transpile_bif, print program:      %9.1f ms (%zu lines, %.2f MB)\n", bifc_seconds * 1e3,
+                lines.size(), source_mb);
+    return sink == 0 ? 1 : 0;
+}
@@ -0,0 +1,80 @@
+// Parse and emit cost of the bifc front end, reported per megabyte of source.
+//
+//   bench_parse [megabytes] [repeats]
+
+#define BIFC_NO_MAIN
+#include "../tools/bifc.cpp"
+
+#include <chrono>
+#include <cstdlib>
+
+namespace {
+
+const std::vector<std::string> kChunk = {
+    "x = 4\n",
+    "if x > 5:\n",
+    "    print(\"big\")\n",
+    "else:\n",
+    "    print(\"small\", x / 3)\n",
+    "while x > 0:\n",
+    "    x = x - 1  # count down\n",
+    "    f = (x <= 2) and not(x == 1) or and(x, True)\n",
+    "for a in 0,1:\n",
+    "    for b in 0,1:\n",
+    "        print(a, b, BIFMath.sqrt(a * a + b * b) / 2)\n",
+    "name = input(\"Name: \")\n",
+    "print(\"Hello, \" + name)\n",
+    "\n",
+};
+
+template <typename Fn>
+double best_seconds(int repeats, Fn&& fn) {
+    double best = 0.0;
+    for (int r = 0; r < repeats; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (r == 0 || elapsed.count() < best) {
+            best = elapsed.count();
+        }
+    }
+    return best;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    double megabytes = (argc > 1) ? std::atof(argv[1]) : 8.0;
+    int repeats = (argc > 2) ? std::atoi(argv[2]) : 5;
+
+    std::string source = "import BIFMath\n";
+    size_t target = static_cast<size_t>(megabytes * 1024.0 * 1024.0);
+    while (source.size() < target) {
+        for (const auto& line : kChunk) {
+            source += line;
+        }
+    }
+    size_t total_bytes = source.size();
+    std::vector<std::string_view> lines = split_lines(source);
+
+    size_t arena_bytes = 0;
+    size_t sink = 0;
+    double parse_seconds = best_seconds(repeats, [&]() {
+        Arena arena;
+        Parser parser(arena);
+        Program program = parser.parse_program(lines);
+        sink += program.body.first != nullptr;
+        arena_bytes = arena.bytes_used();
+    });
+
+    double total_seconds = best_seconds(repeats, [&]() {
+        sink += transpile_bif(lines).body.size();
+    });
+
+    double mb = static_cast<double>(total_bytes) / (1024.0 * 1024.0);
+    std::cout << "source: " << lines.size() << " lines, " << mb << " MB" << std::endl;
+    std::cout << "parse:          " << parse_seconds * 1000.0 / mb << " ms/MB (" << mb / parse_seconds << " MB/s)" << std::endl;
+    std::cout << "parse + emit:   " << total_seconds * 1000.0 / mb << " ms/MB (" << mb / total_seconds << " MB/s)" << std::endl;
+    std::cout << "arena per MB:   " << static_cast<double>(arena_bytes) / mb / 1024.0 << " KB" << std::endl;
+    return sink == 0 ? 1 : 0;
+}
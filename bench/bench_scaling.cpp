@@ -0,0 +1,175 @@
+// How transpile time grows with source size. Generates programs of 1K lines
+// up to `max-lines` (x10 steps) and times each front-end phase: parse,
+// constant folding, dead-store removal, C++ emission and the whole
+// transpile_bif. For each step the growth exponent log(t2/t1)/log(n2/n1) is
+// printed; above 1.25 the phase is flagged as non-linear and the exit code
+// is 1. Steps from 1K lines are only reported, not flagged: they mostly
+// measure warm-up.
+//
+//   bench_scaling [max-lines] [depth] [repeats]
+//   bench_scaling --emit lines [depth] > program.bif
+//
+// max-lines must be at least 10000, the first size whose exponent is
+// checked; anything else is a usage error (exit code 2), not a pass.
+
+#define BIFC_NO_MAIN
+#include "../tools/bifc.cpp"
+
+#include "bif_generator.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+
+namespace {
+
+constexpr double kLinearLimit = 1.25;
+constexpr size_t kFirstCheckedLines = 10000;
+constexpr double kMinPhaseSeconds = 0.05;
+
+const char* const kUsage =
+    "usage: bench_scaling [max-lines >= 10000] [depth] [repeats]\n"
+    "       bench_scaling --emit lines [depth] > program.bif\n";
+
+// Whole argument as a positive decimal number.
+bool parse_count(const char* text, size_t& out) {
+    char* end = nullptr;
+    errno = 0;
+    unsigned long long value = std::strtoull(text, &end, 10);
+    if (!std::isdigit(static_cast<unsigned char>(*text)) || *end != '\0' || errno != 0 || value == 0) {
+        return false;
+    }
+    out = static_cast<size_t>(value);
+    return true;
+}
+
+enum Phase { kParse, kFold, kDeadStores, kEmit, kTranspile, kPhaseCount };
+
+const char* const kPhaseNames[kPhaseCount] = {"parse", "fold", "dead stores", "emit", "transpile"};
+
+struct Sample {
+    size_t lines = 0;
+    double megabytes = 0.0;
+    double seconds[kPhaseCount] = {};
+};
+
+double elapsed_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// One row per size: the repeat with the smallest transpile_bif time, with
+// all its phase times, so the columns of a row come from the same runs.
+// Within a repeat the pipeline (parse, fold, dead stores, emit on one tree,
+// then transpile_bif) runs until every phase has accumulated kMinPhaseSeconds,
+// and the times are averaged, so small phases are not timer noise.
+Sample measure(size_t target_lines, int depth, int repeats) {
+    std::string source = generator::BifGenerator(target_lines, depth).generate();
+    std::vector<std::string_view> lines = split_lines(source);
+    Sample sample;
+    sample.lines = lines.size();
+    sample.megabytes = static_cast<double>(source.size()) / (1024.0 * 1024.0);
+    size_t sink = 0;
+    for (int r = 0; r < repeats; ++r) {
+        double totals[kPhaseCount] = {};
+        int iterations = 0;
+        while (*std::min_element(totals, totals + kPhaseCount) < kMinPhaseSeconds) {
+            {
+                Arena arena;
+                auto start = std::chrono::steady_clock::now();
+                Program program = Parser(arena).parse_program(lines);
+                totals[kParse] += elapsed_since(start);
+                start = std::chrono::steady_clock::now();
+                ConstantFolder(arena).run(program);
+                totals[kFold] += elapsed_since(start);
+                start = std::chrono::steady_clock::now();
+                remove_dead_stores(program);
+                totals[kDeadStores] += elapsed_since(start);
+                start = std::chrono::steady_clock::now();
+                sink += CppEmitter().emit_program(program).body.size();
+                totals[kEmit] += elapsed_since(start);
+            }
+            auto start = std::chrono::steady_clock::now();
+            sink += transpile_bif(lines).body.size();
+            totals[kTranspile] += elapsed_since(start);
+            ++iterations;
+        }
+        if (r == 0 || totals[kTranspile] / iterations < sample.seconds[kTranspile]) {
+            for (int phase = 0; phase < kPhaseCount; ++phase) {
+                sample.seconds[phase] = totals[phase] / iterations;
+            }
+        }
+    }
+    if (sink == 0) {
+        std::cerr << "empty output" << std::endl;
+    }
+    return sample;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    bool emit = argc > 1 && std::string(argv[1]) == "--emit";
+    int first = emit ? 2 : 1;
+    size_t values[3] = {emit ? size_t(1000) : size_t(1000000), 4, 3};
+    bool ok = argc - first <= (emit ? 2 : 3);
+    for (int i = first; ok && i < argc; ++i) {
+        ok = parse_count(argv[i], values[i - first]);
+    }
+    if (!ok || (!emit && values[0] < kFirstCheckedLines)) {
+        std::cerr << kUsage;
+        return 2;
+    }
+    size_t max_lines = values[0];
+    int depth = static_cast<int>(std::min<size_t>(values[1], 64));
+    int repeats = static_cast<int>(std::min<size_t>(values[2], 1000));
+    if (emit) {
+        std::cout << generator::BifGenerator(max_lines, depth).generate();
+        return 0;
+    }
+
+    std::printf("depth %d, fastest of %d repeats by transpile, each phase >= %.0f ms; "
+                "ns per line, growth exponent vs the previous size\n",
+                depth, repeats, kMinPhaseSeconds * 1e3);
+    std::printf("%10s %9s", "lines", "MB");
+    for (const char* name : kPhaseNames) {
+        std::printf(" %12s %6s", name, "exp");
+    }
+    std::printf("\n");
+
+    std::vector<Sample> samples;
+    bool non_linear[kPhaseCount] = {};
+    for (size_t lines = 1000; lines <= max_lines; lines *= 10) {
+        // A 10M-line tree needs gigabytes; one pass is enough there.
+        Sample sample = measure(lines, depth, lines >= 10000000 ? 1 : repeats);
+        std::printf("%10zu %9.2f", sample.lines, sample.megabytes);
+        for (int phase = 0; phase < kPhaseCount; ++phase) {
+            double ns_per_line = sample.seconds[phase] * 1e9 / static_cast<double>(sample.lines);
+            if (samples.empty()) {
+                std::printf(" %12.1f %6s", ns_per_line, "");
+                continue;
+            }
+            const Sample& previous = samples.back();
+            double exponent = std::log(sample.seconds[phase] / previous.seconds[phase]) /
+                              std::log(static_cast<double>(sample.lines) / static_cast<double>(previous.lines));
+            bool flagged = previous.lines >= kFirstCheckedLines && exponent > kLinearLimit;
+            non_linear[phase] = non_linear[phase] || flagged;
+            std::printf(" %12.1f %5.2f%s", ns_per_line, exponent, flagged ? "!" : " ");
+        }
+        std::printf("\n");
+        std::fflush(stdout);
+        samples.push_back(sample);
+    }
+
+    bool any = false;
+    for (int phase = 0; phase < kPhaseCount; ++phase) {
+        if (non_linear[phase]) {
+            std::printf("non-linear growth: %s\n", kPhaseNames[phase]);
+            any = true;
+        }
+    }
+    if (!any) {
+        std::printf("all phases scale linearly (exponent <= %.2f)\n", kLinearLimit);
+    }
+    return any ? 1 : 0;
+}
@@ -0,0 +1,96 @@
+// Synthetic .bif programs for the scaling benchmark. A program is a run of
+// "units": a few assignments with arithmetic, BIFMath calls and and()/or()/
+// not() forms, a multi-argument print, then an if/else whose taken branch
+// nests another unit inside a for, while or if, as long as the blocks stay
+// within `depth` levels of indentation.
+// Variables come from a fixed pool, each name always holding one type, so
+// every generated program transpiles, compiles and terminates.
+#ifndef BIFC_BENCH_BIF_GENERATOR_H
+#define BIFC_BENCH_BIF_GENERATOR_H
+
+#include <cstddef>
+#include <string>
+
+namespace generator {
+
+constexpr size_t kNamePool = 1000;
+
+class BifGenerator {
+public:
+    BifGenerator(size_t target_lines, int depth) : target_lines_(target_lines), depth_(depth < 1 ? 1 : depth) {}
+
+    std::string generate() {
+        out_.clear();
+        lines_ = 0;
+        unit_ = 0;
+        line(0, "import BIFMath");
+        line(0, "from BIFitertools import range");
+        line(0, "seed = int(input())");
+        while (lines_ < target_lines_) {
+            emit_unit(0);
+        }
+        return std::move(out_);
+    }
+
+private:
+    void line(int indent, const std::string& text) {
+        out_.append(static_cast<size_t>(indent) * 4, ' ');
+        out_ += text;
+        out_.push_back('\n');
+        ++lines_;
+    }
+
+    void emit_unit(int level) {
+        size_t unit = unit_++;
+        std::string k = std::to_string(unit % kNamePool);
+        std::string n = std::to_string(unit % 97 + 1);
+        std::string v = "v" + k;
+        std::string f = "f" + k;
+        std::string b = "b" + k;
+        line(level, v + " = seed * " + n + " + " + std::to_string(unit % 7) + " - seed // 3");
+        line(level, f + " = " + v + " / " + n + " + BIFMath.sqrt(" + n + ") * 0.5");
+        line(level, b + " = and(" + v + " > 5, not(" + v + " == 2)) or " + f + " < 1.5");
+        line(level, "print(\"unit " + k + "\", " + v + ", " + f + ", " + b + ")");
+        line(level, "if " + b + " and " + v + " % 3 != 1:");
+        if (level + 3 <= depth_) {
+            emit_nested(level + 1, unit);
+        } else {
+            line(level + 1, "print(" + v + " - 1, " + f + " * 2)");
+        }
+        line(level, "else:");
+        line(level + 1, v + " = " + v + " + " + n);
+        line(level + 1, "print(" + v + ")");
+    }
+
+    // Loop counters are named after their level, so nested loops never
+    // share one.
+    void emit_nested(int level, size_t unit) {
+        std::string i = "i" + std::to_string(level);
+        switch (unit % 3) {
+            case 0:
+                line(level, "for " + i + " in range(2):");
+                emit_unit(level + 1);
+                break;
+            case 1:
+                line(level, i + " = 0");
+                line(level, "while " + i + " < 2:");
+                emit_unit(level + 1);
+                line(level + 1, i + " = " + i + " + 1");
+                break;
+            default:
+                line(level, "if seed > 0 or seed <= 0:");
+                emit_unit(level + 1);
+                break;
+        }
+    }
+
+    size_t target_lines_;
+    int depth_;
+    std::string out_;
+    size_t lines_ = 0;
+    size_t unit_ = 0;
+};
+
+} // namespace generator
+
+#endif // BIFC_BENCH_BIF_GENERATOR_H
@@ -0,0 +1,533 @@
+// Reference copy of the per-pass expression rewriting that bifc used before
+// the token-based normalizer. Kept only so bench_normalize can report a
+// before/after comparison on the same corpus.
+#ifndef BIFC_BENCH_LEGACY_NORMALIZE_H
+#define BIFC_BENCH_LEGACY_NORMALIZE_H
+
+#include <cctype>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace legacy {
+
+std::vector<std::string> split_top_level_args(const std::string& content) {
+    std::vector<std::string> args;
+    std::string current;
+    int depth = 0;
+    bool in_string = false;
+    char string_char = '\0';
+    bool escaped = false;
+
+    for (char ch : content) {
+        if (in_string) {
+            current.push_back(ch);
+            if (escaped) {
+                escaped = false;
+            } else if (ch == '\\') {
+                escaped = true;
+            } else if (ch == string_char) {
+                in_string = false;
+            }
+            continue;
+        }
+
+        if (ch == '"' || ch == '\'') {
+            in_string = true;
+            string_char = ch;
+            current.push_back(ch);
+            continue;
+        }
+
+        if (ch == '(') {
+            depth += 1;
+            current.push_back(ch);
+            continue;
+        }
+        if (ch == ')') {
+            depth -= 1;
+            current.push_back(ch);
+            continue;
+        }
+
+        if (ch == ',' && depth == 0) {
+            auto start = current.find_first_not_of(' ');
+            auto end = current.find_last_not_of(' ');
+            if (start != std::string::npos) {
+                args.push_back(current.substr(start, end - start + 1));
+            }
+            current.clear();
+            continue;
+        }
+
+        current.push_back(ch);
+    }
+
+    auto start = current.find_first_not_of(' ');
+    auto end = current.find_last_not_of(' ');
+    if (start != std::string::npos) {
+        args.push_back(current.substr(start, end - start + 1));
+    }
+
+    return args;
+}
+
+std::string rewrite_logic_functions(const std::string& expr) {
+    auto parse_call = [&](size_t start_index, std::string& content, size_t& end_index) {
+        int depth = 0;
+        bool in_string = false;
+        char string_char = '\0';
+        bool escaped = false;
+        size_t i = start_index;
+
+        while (i < expr.size()) {
+            char ch = expr[i];
+            if (in_string) {
+                if (escaped) {
+                    escaped = false;
+                } else if (ch == '\\') {
+                    escaped = true;
+                } else if (ch == string_char) {
+                    in_string = false;
+                }
+                ++i;
+                continue;
+            }
+
+            if (ch == '"' || ch == '\'') {
+                in_string = true;
+                string_char = ch;
+                ++i;
+                continue;
+            }
+
+            if (ch == '(') {
+                depth += 1;
+            } else if (ch == ')') {
+                depth -= 1;
+                if (depth == 0) {
+                    content = expr.substr(start_index + 1, i - start_index - 1);
+                    end_index = i;
+                    return true;
+                }
+            }
+            ++i;
+        }
+
+        return false;
+    };
+
+
+    std::string out;
+    bool in_string = false;
+    char string_char = '\0';
+    bool escaped = false;
+    size_t i = 0;
+
+    while (i < expr.size()) {
+        char ch = expr[i];
+        if (in_string) {
+            out.push_back(ch);
+            if (escaped) {
+                escaped = false;
+            } else if (ch == '\\') {
+                escaped = true;
+            } else if (ch == string_char) {
+                in_string = false;
+            }
+            ++i;
+            continue;
+        }
+
+        if (ch == '"' || ch == '\'') {
+            in_string = true;
+            string_char = ch;
+            out.push_back(ch);
+            ++i;
+            continue;
+        }
+
+        bool matched = false;
+        for (const std::string name : {"and", "or", "not"}) {
+            std::string token = name + "(";
+            bool boundary = (i == 0 || !(std::isalnum(static_cast<unsigned char>(expr[i - 1])) || expr[i - 1] == '_'));
+            if (boundary && expr.compare(i, token.size(), token) == 0) {
+                std::string content;
+                size_t end_index = 0;
+                if (!parse_call(i + name.size(), content, end_index)) {
+                    break;
+                }
+                auto args = split_top_level_args(content);
+                if (name == "not" && args.size() == 1) {
+                    out += "(!(" + args[0] + "))";
+                } else if (name == "and" && args.size() >= 2) {
+                    out += "(";
+                    for (size_t a = 0; a < args.size(); ++a) {
+                        if (a > 0) {
+                            out += " && ";
+                        }
+                        out += "(" + args[a] + ")";
+                    }
+                    out += ")";
+                } else if (name == "or" && args.size() >= 2) {
+                    out += "(";
+                    for (size_t a = 0; a < args.size(); ++a) {
+                        if (a > 0) {
+                            out += " || ";
+                        }
+                        out += "(" + args[a] + ")";
+                    }
+                    out += ")";
+                } else {
+                    out += expr.substr(i, end_index - i + 1);
+                }
+                i = end_index + 1;
+                matched = true;
+                break;
+            }
+        }
+
+        if (matched) {
+            continue;
+        }
+
+        out.push_back(ch);
+        ++i;
+    }
+
+    return out;
+}
+
+std::string replace_keywords(const std::string& expr) {
+    std::unordered_map<std::string, std::string> replacements = {
+        {"and", "&&"},
+        {"or", "||"},
+        {"not", "!"},
+        {"True", "true"},
+        {"False", "false"},
+        {"None", "nullptr"},
+    };
+
+    std::string out;
+    std::string word;
+    bool in_string = false;
+    char string_char = '\0';
+    bool escaped = false;
+
+    auto flush_word = [&]() {
+        if (!word.empty()) {
+            auto it = replacements.find(word);
+            out += (it != replacements.end()) ? it->second : word;
+            word.clear();
+        }
+    };
+
+    for (char ch : expr) {
+        if (in_string) {
+            out.push_back(ch);
+            if (escaped) {
+                escaped = false;
+            } else if (ch == '\\') {
+                escaped = true;
+            } else if (ch == string_char) {
+                in_string = false;
+            }
+            continue;
+        }
+
+        if (ch == '"' || ch == '\'') {
+            flush_word();
+            in_string = true;
+            string_char = ch;
+            out.push_back(ch);
+            continue;
+        }
+
+        if (std::isalnum(static_cast<unsigned char>(ch)) || ch == '_') {
+            word.push_back(ch);
+        } else {
+            flush_word();
+            out.push_back(ch);
+        }
+    }
+
+    flush_word();
+    return out;
+}
+
+bool expr_has_division(const std::string& expr) {
+    bool in_string = false;
+    char string_char = '\0';
+    bool escaped = false;
+
+    for (char ch : expr) {
+        if (in_string) {
+            if (escaped) {
+                escaped = false;
+            } else if (ch == '\\') {
+                escaped = true;
+            } else if (ch == string_char) {
+                in_string = false;
+            }
+            continue;
+        }
+
+        if (ch == '"' || ch == '\'') {
+            in_string = true;
+            string_char = ch;
+            continue;
+        }
+
+        if (ch == '/') {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+std::string promote_int_literals_for_division(const std::string& expr) {
+    std::string out;
+    bool in_string = false;
+    char string_char = '\0';
+    bool escaped = false;
+    size_t i = 0;
+
+    while (i < expr.size()) {
+        char ch = expr[i];
+
+        if (in_string) {
+            out.push_back(ch);
+            if (escaped) {
+                escaped = false;
+            } else if (ch == '\\') {
+                escaped = true;
+            } else if (ch == string_char) {
+                in_string = false;
+            }
+            ++i;
+            continue;
+        }
+
+        if (ch == '"' || ch == '\'') {
+            in_string = true;
+            string_char = ch;
+            out.push_back(ch);
+            ++i;
+            continue;
+        }
+
+        if (std::isdigit(static_cast<unsigned char>(ch)) &&
+            (i == 0 || !(std::isalnum(static_cast<unsigned char>(expr[i - 1])) || expr[i - 1] == '_'))) {
+            size_t start = i;
+            while (i < expr.size() && std::isdigit(static_cast<unsigned char>(expr[i]))) {
+                ++i;
+            }
+
+            bool is_float = false;
+            if (i < expr.size() && expr[i] == '.') {
+                is_float = true;
+                ++i;
+                while (i < expr.size() && std::isdigit(static_cast<unsigned char>(expr[i]))) {
+                    ++i;
+                }
+            }
+
+            if (i < expr.size() && (expr[i] == 'e' || expr[i] == 'E')) {
+                is_float = true;
+                ++i;
+                if (i < expr.size() && (expr[i] == '+' || expr[i] == '-')) {
+                    ++i;
+                }
+                while (i < expr.size() && std::isdigit(static_cast<unsigned char>(expr[i]))) {
+                    ++i;
+                }
+            }
+
+            std::string token = expr.substr(start, i - start);
+            if (!is_float) {
+                token += ".0";
+            }
+            out += token;
+            continue;
+        }
+
+        out.push_back(ch);
+        ++i;
+    }
+
+    return out;
+}
+
+std::string replace_input_calls(const std::string& expr) {
+    std::string out;
+    bool in_string = false;
+    char string_char = '\0';
+    bool escaped = false;
+    size_t i = 0;
+
+    while (i < expr.size()) {
+        char ch = expr[i];
+
+        if (in_string) {
+            out.push_back(ch);
+            if (escaped) {
+                escaped = false;
+            } else if (ch == '\\') {
+                escaped = true;
+            } else if (ch == string_char) {
+                in_string = false;
+            }
+            ++i;
+            continue;
+        }
+
+        if (ch == '"' || ch == '\'') {
+            in_string = true;
+            string_char = ch;
+            out.push_back(ch);
+            ++i;
+            continue;
+        }
+
+        if (expr.compare(i, 6, "input(") == 0) {
+            out += "bif_input(";
+            i += 6;
+            continue;
+        }
+
+        out.push_back(ch);
+        ++i;
+    }
+
+    return out;
+}
+
+std::string replace_module_access(const std::string& expr, const std::vector<std::string>& modules) {
+    std::string out;
+    bool in_string = false;
+    char string_char = '\0';
+    bool escaped = false;
+    size_t i = 0;
+
+    while (i < expr.size()) {
+        char ch = expr[i];
+
+        if (in_string) {
+            out.push_back(ch);
+            if (escaped) {
+                escaped = false;
+            } else if (ch == '\\') {
+                escaped = true;
+            } else if (ch == string_char) {
+                in_string = false;
+            }
+            ++i;
+            continue;
+        }
+
+        if (ch == '"' || ch == '\'') {
+            in_string = true;
+            string_char = ch;
+            out.push_back(ch);
+            ++i;
+            continue;
+        }
+
+        bool matched = false;
+        for (const auto& module_name : modules) {
+            std::string token = module_name + ".";
+            if (expr.compare(i, token.size(), token) == 0) {
+                out += module_name + "::";
+                i += token.size();
+                matched = true;
+                break;
+            }
+        }
+
+        if (matched) {
+            continue;
+        }
+
+        out.push_back(ch);
+        ++i;
+    }
+
+    return out;
+}
+
+std::string replace_imported_names(const std::string& expr, const std::unordered_map<std::string, std::string>& imported) {
+    std::string out;
+    std::string word;
+    bool in_string = false;
+    char string_char = '\0';
+    bool escaped = false;
+
+    auto flush_word = [&]() {
+        if (word.empty()) {
+            return;
+        }
+        auto it = imported.find(word);
+        if (it != imported.end()) {
+            out += it->second + "::" + word;
+        } else {
+            out += word;
+        }
+        word.clear();
+    };
+
+    for (char ch : expr) {
+        if (in_string) {
+            out.push_back(ch);
+            if (escaped) {
+                escaped = false;
+            } else if (ch == '\\') {
+                escaped = true;
+            } else if (ch == string_char) {
+                in_string = false;
+            }
+            continue;
+        }
+
+        if (ch == '"' || ch == '\'') {
+            flush_word();
+            in_string = true;
+            string_char = ch;
+            out.push_back(ch);
+            continue;
+        }
+
+        if (std::isalnum(static_cast<unsigned char>(ch)) || ch == '_') {
+            word.push_back(ch);
+        } else {
+            flush_word();
+            out.push_back(ch);
+        }
+    }
+
+    flush_word();
+    return out;
+}
+
+std::string normalize_expression(
+    const std::string& expr,
+    const std::vector<std::string>& modules,
+    const std::unordered_map<std::string, std::string>& imported_names) {
+    std::string out = rewrite_logic_functions(expr);
+    out = replace_keywords(out);
+    out = replace_input_calls(out);
+    if (!modules.empty()) {
+        out = replace_module_access(out, modules);
+    }
+    if (!imported_names.empty()) {
+        out = replace_imported_names(out, imported_names);
+    }
+    if (expr_has_division(out)) {
+        out = promote_int_literals_for_division(out);
+    }
+    return out;
+}
+
+} // namespace legacy
+
+#endif // BIFC_BENCH_LEGACY_NORMALIZE_H
@@ -334,7 +334,7 @@ private:
     }
 
     wxString BuildCommand(const wxString& compiler, const wxString& stdinData) {
-        wxString base = QuoteArg(compiler) + " " + QuoteArg(currentPath_) + " --run";
+        wxString base = QuoteArg(compiler) + " " + QuoteArg(currentPath_) + " --run --connect";
 
         if (stdinData.empty()) {
             return base;
@@ -61,7 +61,7 @@ $bashPath = "C:\msys64\usr\bin\bash.exe"
 if (Test-Path $bashPath) {
     $msysRepo = To-MsysPath $RepoPath
     Write-Host "Building C++ compiler..."
-    Invoke-Msys "cd $msysRepo && g++ -std=c++17 -O2 tools/bifc.cpp -o tools/bifc.exe"
+    Invoke-Msys "cd $msysRepo && g++ -std=c++17 -O2 tools/bifc.cpp libs/BIFMath/BIFMath.cpp libs/BIFitertools/BIFitertools.cpp -o tools/bifc.exe"
 
     Write-Host "Building C++ IDE..."
     Invoke-Msys "cd $msysRepo/ide && cmake -S . -B build && cmake --build build"
@@ -31,7 +31,7 @@ fi
 cd "$REPO_PATH"
 
 echo "Building C++ compiler..."
-g++ -std=c++17 -O2 tools/bifc.cpp -o tools/bifc
+g++ -std=c++17 -O2 -pthread tools/bifc.cpp libs/BIFMath/BIFMath.cpp libs/BIFitertools/BIFitertools.cpp -o tools/bifc
 chmod +x tools/bifc
 
 echo "Building C++ IDE..."
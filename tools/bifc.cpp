@@ -1,1004 +1,6375 @@
 #include <algorithm>
+#include <atomic>
 #include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
-namespace fs = std::filesystem;
-
-struct ParseError {
-    std::string message;
-};
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
-std::string strip_comment(const std::string& line) {
-    bool in_string = false;
-    char string_char = '\0';
-    bool escaped = false;
-    std::string out;
+extern char** environ;
+#endif
 
-    for (char ch : line) {
-        if (in_string) {
-            out.push_back(ch);
-            if (escaped) {
-                escaped = false;
-            } else if (ch == '\\') {
-                escaped = true;
-            } else if (ch == string_char) {
-                in_string = false;
-            }
-            continue;
-        }
+#include "../libs/BIFMath/BIFMath.h"
+#include "../libs/BIFitertools/BIFitertools.h"
 
-        if (ch == '"' || ch == '\'') {
-            in_string = true;
-            string_char = ch;
-            out.push_back(ch);
-            continue;
-        }
+namespace fs = std::filesystem;
 
-        if (ch == '#') {
-            break;
-        }
+// --trace / --time-phases: wall-clock spans of bifc's own phases, recorded
+// by TraceScope. Off by default, when a scope costs one relaxed load.
+class Tracer {
+public:
+    using Clock = std::chrono::steady_clock;
 
-        out.push_back(ch);
+    static Tracer& instance() {
+        static Tracer tracer;
+        return tracer;
     }
 
-    return out;
-}
+    void enable() {
+        start_ = Clock::now();
+        enabled_.store(true, std::memory_order_relaxed);
+    }
 
-std::vector<std::string> split_top_level_args(const std::string& content) {
-    std::vector<std::string> args;
-    std::string current;
-    int depth = 0;
-    bool in_string = false;
-    char string_char = '\0';
-    bool escaped = false;
-
-    for (char ch : content) {
-        if (in_string) {
-            current.push_back(ch);
-            if (escaped) {
-                escaped = false;
-            } else if (ch == '\\') {
-                escaped = true;
-            } else if (ch == string_char) {
-                in_string = false;
-            }
-            continue;
-        }
+    bool enabled() const {
+        return enabled_.load(std::memory_order_relaxed);
+    }
 
-        if (ch == '"' || ch == '\'') {
-            in_string = true;
-            string_char = ch;
-            current.push_back(ch);
-            continue;
-        }
+    void record(const char* name, Clock::time_point start, Clock::time_point end, int depth) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto inserted = threads_.emplace(std::this_thread::get_id(), static_cast<unsigned>(threads_.size()) + 1);
+        events_.push_back({name, micros(start), micros(end) - micros(start), inserted.first->second, depth});
+    }
 
-        if (ch == '(') {
-            depth += 1;
-            current.push_back(ch);
-            continue;
-        }
-        if (ch == ')') {
-            depth -= 1;
-            current.push_back(ch);
-            continue;
+    // Chrome trace-event format: load in chrome://tracing or Perfetto.
+    bool write_chrome_trace(const fs::path& path) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::FILE* out = std::fopen(path.string().c_str(), "wb");
+        if (!out) {
+            return false;
         }
-
-        if (ch == ',' && depth == 0) {
-            auto start = current.find_first_not_of(' ');
-            auto end = current.find_last_not_of(' ');
-            if (start != std::string::npos) {
-                args.push_back(current.substr(start, end - start + 1));
-            }
-            current.clear();
-            continue;
+        std::fputs("{\"displayTimeUnit\": \"ms\", \"traceEvents\": [", out);
+        for (size_t i = 0; i < events_.size(); ++i) {
+            const Event& event = events_[i];
+            std::fprintf(out,
+                         "%s\n  {\"name\": \"%s\", \"cat\": \"bifc\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, "
+                         "\"pid\": 1, \"tid\": %u}",
+                         i > 0 ? "," : "", event.name, event.start_us, event.duration_us, event.thread);
         }
-
-        current.push_back(ch);
-    }
-
-    auto start = current.find_first_not_of(' ');
-    auto end = current.find_last_not_of(' ');
-    if (start != std::string::npos) {
-        args.push_back(current.substr(start, end - start + 1));
+        std::fputs("\n]}\n", out);
+        return std::fclose(out) == 0;
     }
 
-    return args;
-}
-
-std::string rewrite_logic_functions(const std::string& expr) {
-    auto parse_call = [&](size_t start_index, std::string& content, size_t& end_index) {
-        int depth = 0;
-        bool in_string = false;
-        char string_char = '\0';
-        bool escaped = false;
-        size_t i = start_index;
-
-        while (i < expr.size()) {
-            char ch = expr[i];
-            if (in_string) {
-                if (escaped) {
-                    escaped = false;
-                } else if (ch == '\\') {
-                    escaped = true;
-                } else if (ch == string_char) {
-                    in_string = false;
-                }
-                ++i;
-                continue;
-            }
-
-            if (ch == '"' || ch == '\'') {
-                in_string = true;
-                string_char = ch;
-                ++i;
-                continue;
-            }
-
-            if (ch == '(') {
-                depth += 1;
-            } else if (ch == ')') {
-                depth -= 1;
-                if (depth == 0) {
-                    content = expr.substr(start_index + 1, i - start_index - 1);
-                    end_index = i;
-                    return true;
-                }
+    // One row per phase name and nesting level, in order of first use, with
+    // the total over all calls (and threads).
+    void print_summary(std::ostream& out) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        struct Row {
+            std::string label;
+            size_t calls;
+            double total_us;
+        };
+        std::vector<const Event*> ordered;
+        for (const Event& event : events_) {
+            ordered.push_back(&event);
+        }
+        std::stable_sort(ordered.begin(), ordered.end(), [](const Event* a, const Event* b) {
+            return a->start_us < b->start_us;
+        });
+        std::vector<Row> rows;
+        std::unordered_map<std::string, size_t> index;
+        for (const Event* event : ordered) {
+            std::string label = std::string(static_cast<size_t>(event->depth) * 2, ' ') + event->name;
+            auto found = index.emplace(label, rows.size());
+            if (found.second) {
+                rows.push_back({label, 0, 0.0});
             }
-            ++i;
+            Row& row = rows[found.first->second];
+            ++row.calls;
+            row.total_us += event->duration_us;
+        }
+        double wall_us = micros(Clock::now());
+        char line[160];
+        std::snprintf(line, sizeof(line), "%-32s %6s %12s %7s\n", "phase", "calls", "ms", "wall");
+        out << "\nbifc phases:\n" << line;
+        for (const Row& row : rows) {
+            std::snprintf(line, sizeof(line), "%-32s %6zu %12.3f %6.1f%%\n", row.label.c_str(), row.calls,
+                          row.total_us / 1000.0, wall_us > 0.0 ? row.total_us * 100.0 / wall_us : 0.0);
+            out << line;
         }
+        std::snprintf(line, sizeof(line), "%-32s %6s %12.3f\n", "total (wall)", "", wall_us / 1000.0);
+        out << line;
+    }
 
-        return false;
+private:
+    struct Event {
+        const char* name;
+        double start_us;
+        double duration_us;
+        unsigned thread;
+        int depth;
     };
 
+    double micros(Clock::time_point at) const {
+        return std::chrono::duration<double, std::micro>(at - start_).count();
+    }
 
-    std::string out;
-    bool in_string = false;
-    char string_char = '\0';
-    bool escaped = false;
-    size_t i = 0;
+    std::atomic<bool> enabled_{false};
+    Clock::time_point start_;
+    mutable std::mutex mutex_;
+    std::vector<Event> events_;
+    std::unordered_map<std::thread::id, unsigned> threads_;
+};
 
-    while (i < expr.size()) {
-        char ch = expr[i];
-        if (in_string) {
-            out.push_back(ch);
-            if (escaped) {
-                escaped = false;
-            } else if (ch == '\\') {
-                escaped = true;
-            } else if (ch == string_char) {
-                in_string = false;
-            }
-            ++i;
-            continue;
+// Records the enclosing block as phase `name` (a string literal).
+class TraceScope {
+public:
+    explicit TraceScope(const char* name) : name_(Tracer::instance().enabled() ? name : nullptr) {
+        if (name_) {
+            depth_ = depth()++;
+            start_ = Tracer::Clock::now();
         }
+    }
 
-        if (ch == '"' || ch == '\'') {
-            in_string = true;
-            string_char = ch;
-            out.push_back(ch);
-            ++i;
-            continue;
-        }
+    ~TraceScope() {
+        end();
+    }
 
-        bool matched = false;
-        for (const std::string& name : {"and", "or", "not"}) {
-            std::string token = name + "(";
-            bool boundary = (i == 0 || !(std::isalnum(static_cast<unsigned char>(expr[i - 1])) || expr[i - 1] == '_'));
-            if (boundary && expr.compare(i, token.size(), token) == 0) {
-                std::string content;
-                size_t end_index = 0;
-                if (!parse_call(i + name.size(), content, end_index)) {
-                    break;
-                }
-                auto args = split_top_level_args(content);
-                if (name == "not" && args.size() == 1) {
-                    out += "(!(" + args[0] + "))";
-                } else if (name == "and" && args.size() >= 2) {
-                    out += "(";
-                    for (size_t a = 0; a < args.size(); ++a) {
-                        if (a > 0) {
-                            out += " && ";
-                        }
-                        out += "(" + args[a] + ")";
-                    }
-                    out += ")";
-                } else if (name == "or" && args.size() >= 2) {
-                    out += "(";
-                    for (size_t a = 0; a < args.size(); ++a) {
-                        if (a > 0) {
-                            out += " || ";
-                        }
-                        out += "(" + args[a] + ")";
-                    }
-                    out += ")";
-                } else {
-                    out += expr.substr(i, end_index - i + 1);
-                }
-                i = end_index + 1;
-                matched = true;
-                break;
-            }
+    // Closes the span before the end of the block.
+    void end() {
+        if (name_) {
+            Tracer::instance().record(name_, start_, Tracer::Clock::now(), depth_);
+            --depth();
+            name_ = nullptr;
         }
+    }
 
-        if (matched) {
-            continue;
-        }
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
 
-        out.push_back(ch);
-        ++i;
+private:
+    static int& depth() {
+        thread_local int depth = 0;
+        return depth;
     }
 
-    return out;
-}
+    const char* name_;
+    int depth_ = 0;
+    Tracer::Clock::time_point start_;
+};
 
-std::string replace_keywords(const std::string& expr) {
-    std::unordered_map<std::string, std::string> replacements = {
-        {"and", "&&"},
-        {"or", "||"},
-        {"not", "!"},
-        {"True", "true"},
-        {"False", "false"},
-        {"None", "nullptr"},
-    };
+struct ParseError {
+    std::string message;
+};
 
-    std::string out;
-    std::string word;
-    bool in_string = false;
-    char string_char = '\0';
-    bool escaped = false;
+bool is_word_char(char ch) {
+    return std::isalnum(static_cast<unsigned char>(ch)) || ch == '_';
+}
 
-    auto flush_word = [&]() {
-        if (!word.empty()) {
-            auto it = replacements.find(word);
-            out += (it != replacements.end()) ? it->second : word;
-            word.clear();
-        }
-    };
+enum class TokenKind {
+    Identifier,
+    Number,
+    String,
+    Operator,
+    Comment,
+};
 
-    for (char ch : expr) {
-        if (in_string) {
-            out.push_back(ch);
-            if (escaped) {
-                escaped = false;
-            } else if (ch == '\\') {
-                escaped = true;
-            } else if (ch == string_char) {
-                in_string = false;
-            }
-            continue;
-        }
+struct Token {
+    TokenKind kind;
+    size_t begin;
+    size_t end;
+    bool is_float = false;
+    bool closed = true;
+};
 
-        if (ch == '"' || ch == '\'') {
-            flush_word();
-            in_string = true;
-            string_char = ch;
-            out.push_back(ch);
-            continue;
-        }
+// Token stream for one line or expression. Tokens are spans into `text`;
+// `partner` maps every bracket token to its matching bracket (npos if unbalanced).
+struct LexedText {
+    std::string_view text;
+    std::vector<Token> tokens;
+    std::vector<size_t> partner;
 
-        if (std::isalnum(static_cast<unsigned char>(ch)) || ch == '_') {
-            word.push_back(ch);
-        } else {
-            flush_word();
-            out.push_back(ch);
-        }
+    std::string_view view(const Token& token) const {
+        return text.substr(token.begin, token.end - token.begin);
     }
 
-    flush_word();
-    return out;
-}
-
-bool expr_has_division(const std::string& expr) {
-    bool in_string = false;
-    char string_char = '\0';
-    bool escaped = false;
-
-    for (char ch : expr) {
-        if (in_string) {
-            if (escaped) {
-                escaped = false;
-            } else if (ch == '\\') {
-                escaped = true;
-            } else if (ch == string_char) {
-                in_string = false;
-            }
-            continue;
-        }
-
-        if (ch == '"' || ch == '\'') {
-            in_string = true;
-            string_char = ch;
-            continue;
-        }
-
-        if (ch == '/') {
-            return true;
-        }
+    bool is_op(size_t index, char op) const {
+        const Token& token = tokens[index];
+        return token.kind == TokenKind::Operator && token.end - token.begin == 1 && text[token.begin] == op;
     }
+};
 
-    return false;
-}
+void lex_text(std::string_view text, LexedText& lexed) {
+    lexed.text = text;
+    lexed.tokens.clear();
+    lexed.partner.clear();
 
-std::string promote_int_literals_for_division(const std::string& expr) {
-    std::string out;
-    bool in_string = false;
-    char string_char = '\0';
-    bool escaped = false;
+    std::vector<size_t> open;
     size_t i = 0;
 
-    while (i < expr.size()) {
-        char ch = expr[i];
+    auto push = [&](TokenKind kind, size_t start, bool is_float = false) {
+        lexed.tokens.push_back({kind, start, i, is_float});
+        lexed.partner.push_back(std::string::npos);
+    };
 
-        if (in_string) {
-            out.push_back(ch);
-            if (escaped) {
-                escaped = false;
-            } else if (ch == '\\') {
-                escaped = true;
-            } else if (ch == string_char) {
-                in_string = false;
-            }
+    while (i < text.size()) {
+        char ch = text[i];
+        size_t start = i;
+
+        if (ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n') {
             ++i;
             continue;
         }
 
         if (ch == '"' || ch == '\'') {
-            in_string = true;
-            string_char = ch;
-            out.push_back(ch);
+            bool escaped = false;
+            bool closed = false;
             ++i;
+            while (i < text.size()) {
+                char current = text[i++];
+                if (escaped) {
+                    escaped = false;
+                } else if (current == '\\') {
+                    escaped = true;
+                } else if (current == ch) {
+                    closed = true;
+                    break;
+                }
+            }
+            push(TokenKind::String, start);
+            lexed.tokens.back().closed = closed;
             continue;
         }
 
-        if (std::isdigit(static_cast<unsigned char>(ch)) &&
-            (i == 0 || !(std::isalnum(static_cast<unsigned char>(expr[i - 1])) || expr[i - 1] == '_'))) {
-            size_t start = i;
-            while (i < expr.size() && std::isdigit(static_cast<unsigned char>(expr[i]))) {
+        if (ch == '#') {
+            i = text.size();
+            push(TokenKind::Comment, start);
+            break;
+        }
+
+        if (std::isalpha(static_cast<unsigned char>(ch)) || ch == '_') {
+            while (i < text.size() && is_word_char(text[i])) {
                 ++i;
             }
+            push(TokenKind::Identifier, start);
+            continue;
+        }
 
+        if (std::isdigit(static_cast<unsigned char>(ch))) {
             bool is_float = false;
-            if (i < expr.size() && expr[i] == '.') {
+            while (i < text.size() && std::isdigit(static_cast<unsigned char>(text[i]))) {
+                ++i;
+            }
+            if (i < text.size() && text[i] == '.') {
                 is_float = true;
                 ++i;
-                while (i < expr.size() && std::isdigit(static_cast<unsigned char>(expr[i]))) {
+                while (i < text.size() && std::isdigit(static_cast<unsigned char>(text[i]))) {
                     ++i;
                 }
             }
-
-            if (i < expr.size() && (expr[i] == 'e' || expr[i] == 'E')) {
+            if (i < text.size() && (text[i] == 'e' || text[i] == 'E')) {
                 is_float = true;
                 ++i;
-                if (i < expr.size() && (expr[i] == '+' || expr[i] == '-')) {
+                if (i < text.size() && (text[i] == '+' || text[i] == '-')) {
                     ++i;
                 }
-                while (i < expr.size() && std::isdigit(static_cast<unsigned char>(expr[i]))) {
+                while (i < text.size() && std::isdigit(static_cast<unsigned char>(text[i]))) {
                     ++i;
                 }
             }
-
-            std::string token = expr.substr(start, i - start);
-            if (!is_float) {
-                token += ".0";
-            }
-            out += token;
+            push(TokenKind::Number, start, is_float);
             continue;
         }
 
-        out.push_back(ch);
         ++i;
-    }
+        if (i < text.size()) {
+            char next = text[i];
+            if ((next == '=' && (ch == '=' || ch == '!' || ch == '<' || ch == '>')) ||
+                (next == '/' && ch == '/') || (next == '*' && ch == '*')) {
+                ++i;
+            }
+        }
+        push(TokenKind::Operator, start);
 
-    return out;
+        if (ch == '(' || ch == '[') {
+            open.push_back(lexed.tokens.size() - 1);
+        } else if ((ch == ')' || ch == ']') && !open.empty()) {
+            size_t match = open.back();
+            open.pop_back();
+            lexed.partner[match] = lexed.tokens.size() - 1;
+            lexed.partner[lexed.tokens.size() - 1] = match;
+        }
+    }
 }
 
-std::string replace_input_calls(const std::string& expr) {
-    std::string out;
-    bool in_string = false;
-    char string_char = '\0';
-    bool escaped = false;
-    size_t i = 0;
+bool is_valid_identifier(std::string_view name) {
+    if (name.empty()) {
+        return false;
+    }
+    if (!(std::isalpha(static_cast<unsigned char>(name[0])) || name[0] == '_')) {
+        return false;
+    }
+    for (char ch : name) {
+        if (!is_word_char(ch)) {
+            return false;
+        }
+    }
+    return true;
+}
 
-    while (i < expr.size()) {
-        char ch = expr[i];
+// Bump allocator for the syntax tree. Nodes are never destroyed individually;
+// the whole tree goes away with the arena.
+class Arena {
+public:
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
 
-        if (in_string) {
-            out.push_back(ch);
-            if (escaped) {
-                escaped = false;
-            } else if (ch == '\\') {
-                escaped = true;
-            } else if (ch == string_char) {
-                in_string = false;
-            }
-            ++i;
-            continue;
+    void* allocate(size_t size, size_t align) {
+        size_t offset = (used_ + align - 1) & ~(align - 1);
+        if (blocks_.empty() || offset + size > capacity_) {
+            capacity_ = std::max(kBlockSize, size + align);
+            blocks_.push_back(std::make_unique<char[]>(capacity_));
+            offset = 0;
         }
+        used_ = offset + size;
+        bytes_ += size;
+        return blocks_.back().get() + offset;
+    }
 
-        if (ch == '"' || ch == '\'') {
-            in_string = true;
-            string_char = ch;
-            out.push_back(ch);
-            ++i;
-            continue;
-        }
+    template <typename T>
+    T* make() {
+        static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+        return new (allocate(sizeof(T), alignof(T))) T{};
+    }
 
-        if (expr.compare(i, 6, "input(") == 0) {
-            out += "bif_input(";
-            i += 6;
-            continue;
+    template <typename T>
+    T* make_array(size_t count) {
+        static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+        return static_cast<T*>(allocate(sizeof(T) * std::max<size_t>(count, 1), alignof(T)));
+    }
+
+    // Releases everything but the first block so the arena can be reused.
+    void reset() {
+        if (blocks_.size() > 1) {
+            blocks_.erase(blocks_.begin() + 1, blocks_.end());
+            capacity_ = kBlockSize;
         }
+        used_ = 0;
+        bytes_ = 0;
+    }
 
-        out.push_back(ch);
-        ++i;
+    size_t bytes_used() const {
+        return bytes_;
     }
 
-    return out;
-}
+private:
+    static constexpr size_t kBlockSize = 64 * 1024;
 
-std::string replace_module_access(const std::string& expr, const std::vector<std::string>& modules) {
-    std::string out;
-    bool in_string = false;
-    char string_char = '\0';
-    bool escaped = false;
-    size_t i = 0;
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    size_t capacity_ = 0;
+    size_t used_ = 0;
+    size_t bytes_ = 0;
+};
 
-    while (i < expr.size()) {
-        char ch = expr[i];
+enum class ExprKind {
+    Name,
+    Number,
+    String,
+    Bool,
+    None,
+    Unary,
+    Binary,
+    Call,
+    Attribute,
+};
 
-        if (in_string) {
-            out.push_back(ch);
-            if (escaped) {
-                escaped = false;
-            } else if (ch == '\\') {
-                escaped = true;
-            } else if (ch == string_char) {
-                in_string = false;
-            }
-            ++i;
-            continue;
-        }
+enum class Op {
+    Or,
+    And,
+    Not,
+    Eq,
+    Ne,
+    Lt,
+    Le,
+    Gt,
+    Ge,
+    Add,
+    Sub,
+    Mul,
+    Div,
+    FloorDiv,
+    Mod,
+    Pow,
+    Neg,
+    Pos,
+};
 
-        if (ch == '"' || ch == '\'') {
-            in_string = true;
-            string_char = ch;
-            out.push_back(ch);
-            ++i;
-            continue;
-        }
+struct Expr;
 
-        bool matched = false;
-        for (const auto& module_name : modules) {
-            std::string token = module_name + ".";
-            if (expr.compare(i, token.size(), token) == 0) {
-                out += module_name + "::";
-                i += token.size();
-                matched = true;
-                break;
-            }
-        }
+struct ExprList {
+    Expr** items = nullptr;
+    size_t size = 0;
 
-        if (matched) {
-            continue;
-        }
+    Expr* const* begin() const {
+        return items;
+    }
 
-        out.push_back(ch);
-        ++i;
+    Expr* const* end() const {
+        return items + size;
     }
+};
 
-    return out;
-}
+// Name: `text` is the identifier, `module` the library it resolves to (may be empty).
+// Number/String: `text` is the source spelling. Attribute: `lhs`.`text`.
+// Unary: `op` `lhs`. Binary: `lhs` `op` `rhs`. Call: `lhs`(`args`).
+struct Expr {
+    ExprKind kind;
+    Op op;
+    std::string_view text;
+    std::string_view module;
+    Expr* lhs;
+    Expr* rhs;
+    ExprList args;
+    bool is_float;
+    bool bool_value;
+};
 
-std::string replace_imported_names(const std::string& expr, const std::unordered_map<std::string, std::string>& imported) {
-    std::string out;
-    std::string word;
-    bool in_string = false;
-    char string_char = '\0';
-    bool escaped = false;
+enum class StmtKind {
+    Expr,
+    Print,
+    Assign,
+    If,
+    While,
+    For,
+};
 
-    auto flush_word = [&]() {
-        if (word.empty()) {
-            return;
-        }
-        auto it = imported.find(word);
-        if (it != imported.end()) {
-            out += it->second + "::" + word;
-        } else {
-            out += word;
-        }
-        word.clear();
-    };
+struct Stmt;
 
-    for (char ch : expr) {
-        if (in_string) {
-            out.push_back(ch);
-            if (escaped) {
-                escaped = false;
-            } else if (ch == '\\') {
-                escaped = true;
-            } else if (ch == string_char) {
-                in_string = false;
-            }
-            continue;
-        }
+struct Block {
+    Stmt* first = nullptr;
+    Stmt* last = nullptr;
 
-        if (ch == '"' || ch == '\'') {
-            flush_word();
-            in_string = true;
-            string_char = ch;
-            out.push_back(ch);
-            continue;
-        }
+    void append(Stmt* stmt);
+};
 
-        if (std::isalnum(static_cast<unsigned char>(ch)) || ch == '_') {
-            word.push_back(ch);
-        } else {
-            flush_word();
-            out.push_back(ch);
-        }
+// Print: `args`. Assign: `name` = `expr`. If/While: `expr` is the condition,
+// `body` and `orelse` the arms. For: `name` iterates over `args`.
+struct Stmt {
+    StmtKind kind;
+    int line;
+    std::string_view name;
+    Expr* expr;
+    ExprList args;
+    Block body;
+    Block orelse;
+    bool has_else;
+    Stmt* next;
+};
+
+void Block::append(Stmt* stmt) {
+    if (last) {
+        last->next = stmt;
+    } else {
+        first = stmt;
     }
+    last = stmt;
+}
 
-    flush_word();
-    return out;
+struct Program {
+    Block body;
+    std::vector<std::string> imports;
+};
+
+const std::vector<std::string_view>& known_modules() {
+    static const std::vector<std::string_view> modules = {"BIFMath", "BIFitertools", "BIFtkinter"};
+    return modules;
 }
 
-std::string normalize_expression(
-    const std::string& expr,
-    const std::vector<std::string>& modules,
-    const std::unordered_map<std::string, std::string>& imported_names) {
-    std::string out = rewrite_logic_functions(expr);
-    out = replace_keywords(out);
-    out = replace_input_calls(out);
-    if (!modules.empty()) {
-        out = replace_module_access(out, modules);
-    }
-    if (!imported_names.empty()) {
-        out = replace_imported_names(out, imported_names);
-    }
-    if (expr_has_division(out)) {
-        out = promote_int_literals_for_division(out);
+std::string_view find_known_module(std::string_view name) {
+    for (std::string_view module_name : known_modules()) {
+        if (module_name == name) {
+            return module_name;
+        }
     }
-    return out;
+    return {};
 }
 
-bool is_valid_identifier(const std::string& name) {
-    if (name.empty()) {
-        return false;
-    }
-    if (!(std::isalpha(static_cast<unsigned char>(name[0])) || name[0] == '_')) {
-        return false;
+bool is_reserved_word(std::string_view word) {
+    return word == "if" || word == "else" || word == "while" || word == "for" || word == "in" ||
+           word == "import" || word == "from" || word == "and" || word == "or" || word == "not";
+}
+
+std::string line_error(int lineno, const std::string& message) {
+    return "Line " + std::to_string(lineno) + ": " + message;
+}
+
+// Builds the syntax tree line by line. Blocks follow the 4-space indentation
+// rules; expressions are parsed by precedence climbing over the token stream.
+class Parser {
+public:
+    explicit Parser(Arena& arena) : arena_(arena) {}
+
+    Program parse_program(const std::vector<std::string_view>& lines);
+
+private:
+    struct OpenBlock {
+        int indent;
+        Block* block;
+    };
+
+    void parse_line(std::string_view stripped);
+    void parse_import(std::string_view module_name);
+    void parse_from_import();
+    Stmt* new_stmt(StmtKind kind);
+    void open_block(Block& block);
+
+    Expr* parse_range(size_t begin, size_t end);
+    Expr* parse_expr(int min_bp);
+    Expr* parse_prefix();
+    Expr* parse_postfix(Expr* lhs);
+    ExprList parse_call_args();
+    ExprList finish_list(size_t scratch_start);
+    Expr* new_expr(ExprKind kind);
+    Expr* binary(Op op, Expr* lhs, Expr* rhs);
+
+    bool at_end() const {
+        return pos_ >= end_;
     }
-    for (char ch : name) {
-        if (!(std::isalnum(static_cast<unsigned char>(ch)) || ch == '_')) {
+
+    bool at_op(char op) const {
+        return !at_end() && lexed_.is_op(pos_, op);
+    }
+
+    bool at_word(std::string_view word) const {
+        return !at_end() && lexed_.tokens[pos_].kind == TokenKind::Identifier && lexed_.view(lexed_.tokens[pos_]) == word;
+    }
+
+    void expect_op(char op);
+    [[noreturn]] void fail(const std::string& message) const;
+    [[noreturn]] void fail_unexpected() const;
+
+    Arena& arena_;
+    LexedText lexed_;
+    size_t pos_ = 0;
+    size_t end_ = 0;
+    int lineno_ = 0;
+    std::vector<OpenBlock> blocks_;
+    bool expect_indent_ = false;
+    Block* pending_block_ = nullptr;
+    std::vector<std::string> imports_;
+    std::unordered_map<std::string_view, std::string_view> imported_names_;
+    std::vector<Expr*> scratch_;
+};
+
+void Parser::fail(const std::string& message) const {
+    throw ParseError{line_error(lineno_, message)};
+}
+
+void Parser::fail_unexpected() const {
+    if (at_end()) {
+        fail("Unexpected end of expression.");
+    }
+    fail("Unexpected '" + std::string(lexed_.view(lexed_.tokens[pos_])) + "'.");
+}
+
+void Parser::expect_op(char op) {
+    if (!at_op(op)) {
+        fail_unexpected();
+    }
+    ++pos_;
+}
+
+Expr* Parser::new_expr(ExprKind kind) {
+    Expr* expr = arena_.make<Expr>();
+    expr->kind = kind;
+    return expr;
+}
+
+Expr* Parser::binary(Op op, Expr* lhs, Expr* rhs) {
+    Expr* expr = new_expr(ExprKind::Binary);
+    expr->op = op;
+    expr->lhs = lhs;
+    expr->rhs = rhs;
+    return expr;
+}
+
+ExprList Parser::finish_list(size_t scratch_start) {
+    ExprList list;
+    list.size = scratch_.size() - scratch_start;
+    list.items = arena_.make_array<Expr*>(list.size);
+    std::copy(scratch_.begin() + static_cast<std::ptrdiff_t>(scratch_start), scratch_.end(), list.items);
+    scratch_.resize(scratch_start);
+    return list;
+}
+
+Stmt* Parser::new_stmt(StmtKind kind) {
+    Stmt* stmt = arena_.make<Stmt>();
+    stmt->kind = kind;
+    stmt->line = lineno_;
+    blocks_.back().block->append(stmt);
+    return stmt;
+}
+
+void Parser::open_block(Block& block) {
+    expect_indent_ = true;
+    pending_block_ = &block;
+}
+
+struct BindingPower {
+    Op op;
+    int left;
+    bool right_assoc;
+};
+
+bool infix_binding(const LexedText& lexed, size_t index, BindingPower& out) {
+    const Token& token = lexed.tokens[index];
+    std::string_view text = lexed.view(token);
+    if (token.kind == TokenKind::Identifier) {
+        if (text == "or") {
+            out = {Op::Or, 1, false};
+            return true;
+        }
+        if (text == "and") {
+            out = {Op::And, 2, false};
+            return true;
+        }
+        return false;
+    }
+    if (token.kind != TokenKind::Operator) {
+        return false;
+    }
+    bool pair = text.size() == 2;
+    switch (text[0]) {
+        case '=':
+            out = {Op::Eq, 4, false};
+            return pair;
+        case '!':
+            out = {Op::Ne, 4, false};
+            return pair;
+        case '<':
+            out = {pair ? Op::Le : Op::Lt, 4, false};
+            return true;
+        case '>':
+            out = {pair ? Op::Ge : Op::Gt, 4, false};
+            return true;
+        case '+':
+            out = {Op::Add, 5, false};
+            return true;
+        case '-':
+            out = {Op::Sub, 5, false};
+            return true;
+        case '*':
+            out = pair ? BindingPower{Op::Pow, 8, true} : BindingPower{Op::Mul, 6, false};
+            return true;
+        case '/':
+            out = {pair ? Op::FloorDiv : Op::Div, 6, false};
+            return true;
+        case '%':
+            out = {Op::Mod, 6, false};
+            return true;
+        default:
             return false;
+    }
+}
+
+constexpr int kNotBindingPower = 3;
+constexpr int kUnaryBindingPower = 7;
+
+Expr* Parser::parse_range(size_t begin, size_t end) {
+    pos_ = begin;
+    end_ = end;
+    if (at_end()) {
+        fail("Missing expression.");
+    }
+    Expr* expr = parse_expr(0);
+    if (!at_end()) {
+        fail_unexpected();
+    }
+    return expr;
+}
+
+Expr* Parser::parse_expr(int min_bp) {
+    Expr* lhs = parse_prefix();
+    while (!at_end()) {
+        BindingPower binding;
+        if (!infix_binding(lexed_, pos_, binding) || binding.left <= min_bp) {
+            break;
         }
+        ++pos_;
+        Expr* rhs = parse_expr(binding.right_assoc ? binding.left - 1 : binding.left);
+        lhs = binary(binding.op, lhs, rhs);
     }
-    return true;
+    return lhs;
 }
 
-std::pair<std::string, std::string> split_assignment(const std::string& line) {
-    for (size_t i = 0; i < line.size(); ++i) {
-        if (line[i] != '=') {
+Expr* Parser::parse_prefix() {
+    if (at_end()) {
+        fail_unexpected();
+    }
+    const Token& token = lexed_.tokens[pos_];
+    std::string_view text = lexed_.view(token);
+
+    if (token.kind == TokenKind::Number) {
+        ++pos_;
+        Expr* expr = new_expr(ExprKind::Number);
+        expr->text = text;
+        expr->is_float = token.is_float;
+        return parse_postfix(expr);
+    }
+
+    if (token.kind == TokenKind::String) {
+        if (!token.closed) {
+            fail("Unterminated string.");
+        }
+        ++pos_;
+        Expr* expr = new_expr(ExprKind::String);
+        expr->text = text;
+        return parse_postfix(expr);
+    }
+
+    if (token.kind == TokenKind::Operator) {
+        if (at_op('(')) {
+            ++pos_;
+            Expr* inner = parse_expr(0);
+            expect_op(')');
+            return parse_postfix(inner);
+        }
+        if (at_op('-') || at_op('+')) {
+            ++pos_;
+            Expr* expr = new_expr(ExprKind::Unary);
+            expr->op = (text == "-") ? Op::Neg : Op::Pos;
+            expr->lhs = parse_expr(kUnaryBindingPower);
+            return expr;
+        }
+        fail_unexpected();
+    }
+
+    if (token.kind != TokenKind::Identifier) {
+        fail_unexpected();
+    }
+
+    if (text == "True" || text == "False") {
+        ++pos_;
+        Expr* expr = new_expr(ExprKind::Bool);
+        expr->bool_value = (text == "True");
+        return parse_postfix(expr);
+    }
+    if (text == "None") {
+        ++pos_;
+        return parse_postfix(new_expr(ExprKind::None));
+    }
+    if (text == "not") {
+        ++pos_;
+        Expr* expr = new_expr(ExprKind::Unary);
+        expr->op = Op::Not;
+        expr->lhs = parse_expr(kNotBindingPower);
+        return expr;
+    }
+    if ((text == "and" || text == "or") && pos_ + 1 < end_ && lexed_.is_op(pos_ + 1, '(')) {
+        Op op = (text == "and") ? Op::And : Op::Or;
+        ++pos_;
+        ExprList args = parse_call_args();
+        if (args.size < 2) {
+            fail(std::string(text) + "() needs at least two arguments.");
+        }
+        Expr* folded = args.items[0];
+        for (size_t i = 1; i < args.size; ++i) {
+            folded = binary(op, folded, args.items[i]);
+        }
+        return parse_postfix(folded);
+    }
+    if (is_reserved_word(text)) {
+        fail_unexpected();
+    }
+
+    ++pos_;
+    Expr* expr = new_expr(ExprKind::Name);
+    expr->text = text;
+
+    std::string_view module_name;
+    if (std::find(imports_.begin(), imports_.end(), text) != imports_.end()) {
+        module_name = find_known_module(text);
+    }
+    if (!module_name.empty() && at_op('.') && pos_ + 1 < end_ &&
+        lexed_.tokens[pos_ + 1].kind == TokenKind::Identifier) {
+        expr->text = lexed_.view(lexed_.tokens[pos_ + 1]);
+        expr->module = module_name;
+        pos_ += 2;
+    } else {
+        auto imported = imported_names_.find(text);
+        if (imported != imported_names_.end()) {
+            expr->module = imported->second;
+        }
+    }
+    return parse_postfix(expr);
+}
+
+Expr* Parser::parse_postfix(Expr* lhs) {
+    while (!at_end()) {
+        if (at_op('(')) {
+            Expr* call = new_expr(ExprKind::Call);
+            call->lhs = lhs;
+            call->args = parse_call_args();
+            lhs = call;
+            continue;
+        }
+        if (at_op('.')) {
+            ++pos_;
+            if (at_end() || lexed_.tokens[pos_].kind != TokenKind::Identifier) {
+                fail_unexpected();
+            }
+            Expr* attribute = new_expr(ExprKind::Attribute);
+            attribute->lhs = lhs;
+            attribute->text = lexed_.view(lexed_.tokens[pos_]);
+            ++pos_;
+            lhs = attribute;
+            continue;
+        }
+        break;
+    }
+    return lhs;
+}
+
+ExprList Parser::parse_call_args() {
+    expect_op('(');
+    size_t scratch_start = scratch_.size();
+    while (!at_op(')')) {
+        scratch_.push_back(parse_expr(0));
+        if (!at_op(',')) {
+            break;
+        }
+        ++pos_;
+    }
+    expect_op(')');
+    return finish_list(scratch_start);
+}
+
+void Parser::parse_import(std::string_view module_name) {
+    if (find_known_module(module_name).empty()) {
+        fail("Unknown module '" + std::string(module_name) + "'.");
+    }
+    if (std::find(imports_.begin(), imports_.end(), module_name) == imports_.end()) {
+        imports_.emplace_back(module_name);
+    }
+}
+
+void Parser::parse_from_import() {
+    size_t import_pos = 1;
+    while (import_pos < end_ && !(lexed_.tokens[import_pos].kind == TokenKind::Identifier &&
+                                  lexed_.view(lexed_.tokens[import_pos]) == "import")) {
+        ++import_pos;
+    }
+    if (import_pos >= end_ || import_pos == 1) {
+        fail("Invalid import syntax.");
+    }
+    size_t module_begin = lexed_.tokens[1].begin;
+    size_t module_end = lexed_.tokens[import_pos - 1].end;
+    std::string_view module_name = lexed_.text.substr(module_begin, module_end - module_begin);
+    parse_import(module_name);
+    std::string_view resolved = find_known_module(module_name);
+
+    bool has_name = false;
+    size_t name_begin = import_pos + 1;
+    for (size_t i = import_pos + 1; i <= end_; ++i) {
+        if (i < end_ && !lexed_.is_op(i, ',')) {
+            continue;
+        }
+        if (i > name_begin) {
+            size_t begin = lexed_.tokens[name_begin].begin;
+            size_t end = lexed_.tokens[i - 1].end;
+            std::string_view name = lexed_.text.substr(begin, end - begin);
+            if (!is_valid_identifier(name)) {
+                fail("Invalid import name '" + std::string(name) + "'.");
+            }
+            imported_names_[name] = resolved;
+            has_name = true;
+        }
+        name_begin = i + 1;
+    }
+    if (!has_name) {
+        fail("No imports listed.");
+    }
+}
+
+void Parser::parse_line(std::string_view stripped) {
+    end_ = lexed_.tokens.size();
+    const Token& first = lexed_.tokens[0];
+    std::string_view keyword = (first.kind == TokenKind::Identifier) ? lexed_.view(first) : std::string_view();
+    bool has_colon = lexed_.is_op(end_ - 1, ':');
+
+    if (keyword == "import") {
+        size_t begin = (end_ > 1) ? lexed_.tokens[1].begin : stripped.size();
+        parse_import(stripped.substr(begin));
+        return;
+    }
+
+    if (keyword == "from") {
+        parse_from_import();
+        return;
+    }
+
+    if (keyword == "for" && has_colon) {
+        size_t in_pos = 1;
+        while (in_pos < end_ - 1 && !(lexed_.tokens[in_pos].kind == TokenKind::Identifier &&
+                                      lexed_.view(lexed_.tokens[in_pos]) == "in")) {
+            ++in_pos;
+        }
+        if (in_pos >= end_ - 1) {
+            fail("Invalid for-loop syntax.");
+        }
+        std::string_view name;
+        if (in_pos == 2) {
+            name = lexed_.view(lexed_.tokens[1]);
+        }
+        if (!is_valid_identifier(name) || is_reserved_word(name)) {
+            fail("Invalid variable name.");
+        }
+        if (in_pos + 1 == end_ - 1) {
+            fail("Empty for-loop iterable.");
+        }
+
+        Stmt* stmt = new_stmt(StmtKind::For);
+        stmt->name = name;
+        pos_ = in_pos + 1;
+        end_ = end_ - 1;
+        size_t scratch_start = scratch_.size();
+        while (!at_end()) {
+            scratch_.push_back(parse_expr(0));
+            if (!at_end()) {
+                expect_op(',');
+            }
+        }
+        stmt->args = finish_list(scratch_start);
+        open_block(stmt->body);
+        return;
+    }
+
+    if ((keyword == "if" || keyword == "while") && has_colon) {
+        Stmt* stmt = new_stmt(keyword == "if" ? StmtKind::If : StmtKind::While);
+        stmt->expr = parse_range(1, end_ - 1);
+        open_block(stmt->body);
+        return;
+    }
+
+    if (keyword == "if" || keyword == "while" || keyword == "for" || keyword == "else") {
+        if (!has_colon) {
+            fail("Expected ':' at end of line.");
+        }
+    }
+
+    if (keyword == "else") {
+        Stmt* owner = blocks_.back().block->last;
+        if (end_ != 2 || !owner || owner->kind != StmtKind::If || owner->has_else) {
+            fail("'else' without matching 'if'.");
+        }
+        owner->has_else = true;
+        open_block(owner->orelse);
+        return;
+    }
+
+    for (size_t i = 0; i < end_; ++i) {
+        const Token& token = lexed_.tokens[i];
+        if (token.kind != TokenKind::Operator || lexed_.view(token) != "=") {
             continue;
         }
-        char prev = (i > 0) ? line[i - 1] : '\0';
-        char next = (i + 1 < line.size()) ? line[i + 1] : '\0';
-        if (prev == '=' || prev == '!' || prev == '<' || prev == '>' || next == '=') {
+        if (i != 1 || first.kind != TokenKind::Identifier || is_reserved_word(lexed_.view(first))) {
+            fail("Invalid variable name.");
+        }
+        Stmt* stmt = new_stmt(StmtKind::Assign);
+        stmt->name = lexed_.view(first);
+        stmt->expr = parse_range(2, end_);
+        return;
+    }
+
+    Expr* expr = parse_range(0, end_);
+    if (expr->kind == ExprKind::Call && expr->lhs->kind == ExprKind::Name && expr->lhs->module.empty() &&
+        expr->lhs->text == "print") {
+        Stmt* stmt = new_stmt(StmtKind::Print);
+        stmt->args = expr->args;
+        return;
+    }
+    Stmt* stmt = new_stmt(StmtKind::Expr);
+    stmt->expr = expr;
+}
+
+Program Parser::parse_program(const std::vector<std::string_view>& lines) {
+    Program program;
+    blocks_.assign(1, {0, &program.body});
+    expect_indent_ = false;
+    pending_block_ = nullptr;
+
+    for (size_t index = 0; index < lines.size(); ++index) {
+        lineno_ = static_cast<int>(index) + 1;
+        lex_text(lines[index], lexed_);
+
+        size_t code_end = lexed_.text.size();
+        if (!lexed_.tokens.empty() && lexed_.tokens.back().kind == TokenKind::Comment) {
+            code_end = lexed_.tokens.back().begin;
+            lexed_.tokens.pop_back();
+            lexed_.partner.pop_back();
+        }
+        std::string_view line = lexed_.text.substr(0, code_end);
+        if (line.find('\t') != std::string_view::npos) {
+            fail("Tabs are not allowed. Use 4 spaces.");
+        }
+        if (lexed_.tokens.empty()) {
             continue;
         }
-        return {line.substr(0, i), line.substr(i + 1)};
+
+        int indent = static_cast<int>(line.find_first_not_of(' '));
+        if (indent % 4 != 0) {
+            fail("Indentation must be multiples of 4 spaces.");
+        }
+        if (indent > blocks_.back().indent) {
+            if (!expect_indent_) {
+                fail("Unexpected indentation.");
+            }
+            blocks_.push_back({indent, pending_block_});
+            expect_indent_ = false;
+        }
+        while (indent < blocks_.back().indent) {
+            blocks_.pop_back();
+        }
+        if (expect_indent_ && indent == blocks_.back().indent) {
+            fail("Expected indented block.");
+        }
+
+        std::string_view stripped = line.substr(static_cast<size_t>(indent));
+        while (!stripped.empty() && (stripped.back() == ' ' || stripped.back() == '\r' || stripped.back() == '\n')) {
+            stripped.remove_suffix(1);
+        }
+        parse_line(stripped);
+    }
+
+    if (expect_indent_) {
+        fail("Expected indented block.");
+    }
+
+    program.imports = imports_;
+    return program;
+}
+
+// Call of a built-in function such as input() or int().
+bool is_builtin_call(const Expr* expr, std::string_view name) {
+    return expr->kind == ExprKind::Call && expr->lhs->kind == ExprKind::Name && expr->lhs->module.empty() &&
+           expr->lhs->text == name;
+}
+
+// C++ precedence of the emitted form; higher binds tighter.
+int cpp_precedence(const Expr* expr) {
+    if (expr->kind == ExprKind::Unary) {
+        return 14;
+    }
+    if (expr->kind != ExprKind::Binary) {
+        return 16;
+    }
+    switch (expr->op) {
+        case Op::Or:
+            return 3;
+        case Op::And:
+            return 4;
+        case Op::Eq:
+        case Op::Ne:
+            return 8;
+        case Op::Lt:
+        case Op::Le:
+        case Op::Gt:
+        case Op::Ge:
+            return 9;
+        case Op::Add:
+        case Op::Sub:
+            return 11;
+        case Op::Mul:
+        case Op::Div:
+        case Op::Mod:
+            return 12;
+        default:
+            return 16;
+    }
+}
+
+const char* cpp_operator(Op op) {
+    switch (op) {
+        case Op::Or:
+            return " || ";
+        case Op::And:
+            return " && ";
+        case Op::Eq:
+            return " == ";
+        case Op::Ne:
+            return " != ";
+        case Op::Lt:
+            return " < ";
+        case Op::Le:
+            return " <= ";
+        case Op::Gt:
+            return " > ";
+        case Op::Ge:
+            return " >= ";
+        case Op::Add:
+            return " + ";
+        case Op::Sub:
+            return " - ";
+        case Op::Mul:
+            return " * ";
+        case Op::Div:
+            return " / ";
+        case Op::Mod:
+            return " % ";
+        case Op::Not:
+            return "!";
+        case Op::Neg:
+            return "-";
+        case Op::Pos:
+            return "+";
+        default:
+            return "";
     }
-    return {"", ""};
 }
 
+// 64-bit FNV-1a over everything fed to it.
+class ContentHash {
+public:
+    void update(std::string_view data) {
+        for (unsigned char ch : data) {
+            state_ ^= ch;
+            state_ *= 1099511628211ULL;
+        }
+    }
+
+    std::string hex() const {
+        static const char digits[] = "0123456789abcdef";
+        std::string out(16, '0');
+        uint64_t value = state_;
+        for (int i = 15; i >= 0; --i) {
+            out[static_cast<size_t>(i)] = digits[value & 0xf];
+            value >>= 4;
+        }
+        return out;
+    }
+
+    uint64_t value() const {
+        return state_;
+    }
+
+private:
+    uint64_t state_ = 14695981039346656037ULL;
+};
+
 struct TranspileResult {
-    std::vector<std::string> body;
+    std::string body;
     std::vector<std::string> imports;
+    bool uses_cmath = false;
+    bool flush_lines = false;
+    // --profile / --mem-stats builds: source text of every line that calls
+    // bif_line(), emitted ahead of main() for the reports.
+    std::string line_table;
+    bool profile = false;
+    bool mem_stats = false;
+    // Split builds of large programs: every variable lives in namespace
+    // bif_vars (`globals`, ahead of main()), and `body` only calls the
+    // chunk functions. Each chunk is a separate translation unit named by
+    // its content, so an edit recompiles only the chunks it touches.
+    std::string globals;
+    std::vector<std::string> chunks;
 };
 
-TranspileResult transpile_bif(const std::vector<std::string>& lines) {
-    std::vector<std::string> out;
-    std::vector<int> indent_stack = {0};
-    bool expect_indent = false;
-    std::unordered_set<std::string> defined;
-    std::vector<std::string> imports;
-    std::unordered_map<std::string, std::string> imported_names;
-    std::unordered_set<std::string> known_imports = {"BIFMath", "BIFitertools", "BIFtkinter"};
+// Static type of a variable or expression in the generated C++. Dynamic is
+// anything the inference cannot name (library objects, method results,
+// conflicting assignments); such variables keep `auto` declarations.
+enum class CppType : uint8_t {
+    Unknown,
+    Bool,
+    Int,
+    Double,
+    String,
+    IntList,
+    StringList,
+    Dynamic,
+};
 
-    for (size_t index = 0; index < lines.size(); ++index) {
-        int lineno = static_cast<int>(index) + 1;
-        std::string line = strip_comment(lines[index]);
-        while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) {
-            line.pop_back();
+bool is_numeric(CppType type) {
+    return type == CppType::Bool || type == CppType::Int || type == CppType::Double;
+}
+
+CppType join_types(CppType a, CppType b) {
+    if (a == b || b == CppType::Unknown) {
+        return a;
+    }
+    if (a == CppType::Unknown) {
+        return b;
+    }
+    if (is_numeric(a) && is_numeric(b)) {
+        return (a == CppType::Double || b == CppType::Double) ? CppType::Double : CppType::Int;
+    }
+    return CppType::Dynamic;
+}
+
+const char* cpp_type_name(CppType type) {
+    switch (type) {
+        case CppType::Bool:
+            return "bool";
+        case CppType::Int:
+            return "int64_t";
+        case CppType::Double:
+            return "double";
+        case CppType::String:
+            return "std::string";
+        case CppType::IntList:
+            return "std::vector<int>";
+        case CppType::StringList:
+            return "std::vector<std::string>";
+        default:
+            return "auto";
+    }
+}
+
+// Whole-program inference: every variable gets the join of all values
+// assigned to it (int64 < double; bool widens to int), iterated to a fixed
+// point so `x = x + 0.5` inside a loop makes `x` a double everywhere.
+class TypeInference {
+public:
+    void run(const Program& program);
+    CppType type_of(const Expr* expr) const;
+    CppType element_type(const Stmt* loop) const;
+
+    // Concrete type of a variable, or Dynamic when it has none.
+    CppType variable_type(std::string_view name) const {
+        auto it = types_.find(name);
+        if (it == types_.end() || it->second == CppType::Unknown) {
+            return CppType::Dynamic;
+        }
+        return it->second;
+    }
+
+    // Assigned variables in order of first assignment.
+    const std::vector<std::string_view>& assigned() const {
+        return assigned_;
+    }
+
+private:
+    bool visit_block(const Block& block);
+    bool widen(std::string_view name, CppType type);
+
+    std::unordered_map<std::string_view, CppType> types_;
+    std::vector<std::string_view> assigned_;
+    std::unordered_set<std::string_view> seen_;
+};
+
+CppType TypeInference::type_of(const Expr* expr) const {
+    switch (expr->kind) {
+        case ExprKind::Name: {
+            if (!expr->module.empty()) {
+                return CppType::Dynamic;
+            }
+            auto it = types_.find(expr->text);
+            return it == types_.end() ? CppType::Unknown : it->second;
         }
-        if (line.find('\t') != std::string::npos) {
-            throw ParseError{"Line " + std::to_string(lineno) + ": Tabs are not allowed. Use 4 spaces."};
+        case ExprKind::Number:
+            return expr->is_float ? CppType::Double : CppType::Int;
+        case ExprKind::String:
+            return CppType::String;
+        case ExprKind::Bool:
+            return CppType::Bool;
+        case ExprKind::None:
+        case ExprKind::Attribute:
+            return CppType::Dynamic;
+        case ExprKind::Unary: {
+            if (expr->op == Op::Not) {
+                return CppType::Bool;
+            }
+            CppType operand = type_of(expr->lhs);
+            if (operand == CppType::Unknown || operand == CppType::Bool) {
+                return operand == CppType::Bool ? CppType::Int : operand;
+            }
+            return is_numeric(operand) ? operand : CppType::Dynamic;
         }
-        auto first_non_space = line.find_first_not_of(' ');
-        if (first_non_space == std::string::npos) {
-            continue;
+        case ExprKind::Binary: {
+            switch (expr->op) {
+                case Op::Or:
+                case Op::And:
+                case Op::Eq:
+                case Op::Ne:
+                case Op::Lt:
+                case Op::Le:
+                case Op::Gt:
+                case Op::Ge:
+                    return CppType::Bool;
+                case Op::Div:
+                    return CppType::Double;
+                default:
+                    break;
+            }
+            CppType lhs = type_of(expr->lhs);
+            CppType rhs = type_of(expr->rhs);
+            if (lhs == CppType::Unknown || rhs == CppType::Unknown) {
+                return CppType::Unknown;
+            }
+            if (expr->op == Op::Add && lhs == CppType::String && rhs == CppType::String) {
+                return CppType::String;
+            }
+            // `**` stays integral unless the exponent is a negative constant.
+            if (expr->op == Op::Pow && is_numeric(lhs) && is_numeric(rhs)) {
+                bool negative = expr->rhs->kind == ExprKind::Unary && expr->rhs->op == Op::Neg;
+                bool integral = lhs != CppType::Double && rhs != CppType::Double;
+                return integral && !negative ? CppType::Int : CppType::Double;
+            }
+            if (is_numeric(lhs) && is_numeric(rhs)) {
+                return join_types(join_types(lhs, rhs), CppType::Int);
+            }
+            return CppType::Dynamic;
+        }
+        case ExprKind::Call: {
+            const Expr* callee = expr->lhs;
+            if (callee->kind != ExprKind::Name) {
+                return CppType::Dynamic;
+            }
+            if (callee->module.empty()) {
+                if (callee->text == "input") {
+                    return CppType::String;
+                }
+                if (callee->text == "int") {
+                    return CppType::Int;
+                }
+                if (callee->text == "float") {
+                    return CppType::Double;
+                }
+                if (callee->text == "input_lines") {
+                    return CppType::StringList;
+                }
+            }
+            if (callee->module == "BIFMath") {
+                return CppType::Double;
+            }
+            if (callee->module == "BIFitertools") {
+                return callee->text == "repeat" ? CppType::StringList : CppType::IntList;
+            }
+            return CppType::Dynamic;
+        }
+    }
+    return CppType::Dynamic;
+}
+
+// Type of the items a `for` loop binds: the elements of a single list-valued
+// iterable, or the join of the literal items.
+CppType TypeInference::element_type(const Stmt* loop) const {
+    if (loop->args.size == 1) {
+        CppType iterable = type_of(loop->args.items[0]);
+        if (iterable == CppType::IntList) {
+            return CppType::Int;
+        }
+        if (iterable == CppType::StringList) {
+            return CppType::String;
+        }
+    }
+    CppType type = CppType::Unknown;
+    for (const Expr* item : loop->args) {
+        type = join_types(type, type_of(item));
+    }
+    return type;
+}
+
+bool TypeInference::widen(std::string_view name, CppType type) {
+    CppType& current = types_[name];
+    CppType joined = join_types(current, type);
+    if (joined == current) {
+        return false;
+    }
+    current = joined;
+    return true;
+}
+
+bool TypeInference::visit_block(const Block& block) {
+    bool changed = false;
+    for (const Stmt* stmt = block.first; stmt; stmt = stmt->next) {
+        // A loop target is assigned like any variable: it keeps its last
+        // item after the loop.
+        if (stmt->kind == StmtKind::Assign || stmt->kind == StmtKind::For) {
+            if (seen_.insert(stmt->name).second) {
+                assigned_.push_back(stmt->name);
+            }
+            changed |= widen(stmt->name, stmt->kind == StmtKind::Assign ? type_of(stmt->expr) : element_type(stmt));
+        }
+        changed |= visit_block(stmt->body);
+        changed |= visit_block(stmt->orelse);
+    }
+    return changed;
+}
+
+void TypeInference::run(const Program& program) {
+    types_.clear();
+    assigned_.clear();
+    seen_.clear();
+    while (visit_block(program.body)) {
+    }
+}
+
+// Backward liveness over the tree. An assignment is dead when no path reads
+// the value before the variable is assigned again; a read in an assignment
+// is a last use when the variable is dead right after that statement, so the
+// emitter can move from it instead of copying.
+class Liveness {
+public:
+    void run(const Program& program);
+
+    bool is_dead(const Stmt* stmt) const {
+        return dead_.count(stmt) != 0;
+    }
+
+    bool is_last_use(const Expr* name) const {
+        return last_uses_.count(name) != 0;
+    }
+
+private:
+    using Names = std::unordered_set<std::string_view>;
+
+    void visit_block(const Block& block, Names& live);
+    void visit_stmt(const Stmt* stmt, Names& live);
+
+    std::unordered_set<const Stmt*> dead_;
+    std::unordered_set<const Expr*> last_uses_;
+};
+
+// Calls are the only expressions with effects (input(), widgets, ...).
+bool has_call(const Expr* expr) {
+    if (!expr) {
+        return false;
+    }
+    if (expr->kind == ExprKind::Call) {
+        return true;
+    }
+    return has_call(expr->lhs) || has_call(expr->rhs);
+}
+
+void collect_reads(const Expr* expr, std::vector<const Expr*>& reads) {
+    if (!expr) {
+        return;
+    }
+    if (expr->kind == ExprKind::Name) {
+        if (expr->module.empty()) {
+            reads.push_back(expr);
+        }
+        return;
+    }
+    collect_reads(expr->lhs, reads);
+    collect_reads(expr->rhs, reads);
+    for (const Expr* arg : expr->args) {
+        collect_reads(arg, reads);
+    }
+}
+
+void add_reads(const Expr* expr, std::unordered_set<std::string_view>& live) {
+    std::vector<const Expr*> reads;
+    collect_reads(expr, reads);
+    for (const Expr* read : reads) {
+        live.insert(read->text);
+    }
+}
+
+void Liveness::run(const Program& program) {
+    dead_.clear();
+    last_uses_.clear();
+    Names live;
+    visit_block(program.body, live);
+}
+
+void Liveness::visit_block(const Block& block, Names& live) {
+    std::vector<const Stmt*> stmts;
+    for (const Stmt* stmt = block.first; stmt; stmt = stmt->next) {
+        stmts.push_back(stmt);
+    }
+    for (auto it = stmts.rbegin(); it != stmts.rend(); ++it) {
+        visit_stmt(*it, live);
+    }
+}
+
+// Turns `live` from the set live after `stmt` into the set live before it.
+// Loops are revisited until their head set stops growing; the marks of the
+// last visit are the ones that hold.
+void Liveness::visit_stmt(const Stmt* stmt, Names& live) {
+    switch (stmt->kind) {
+        case StmtKind::Print:
+            for (const Expr* arg : stmt->args) {
+                add_reads(arg, live);
+            }
+            return;
+        case StmtKind::Expr:
+            add_reads(stmt->expr, live);
+            return;
+        case StmtKind::Assign: {
+            bool dead = live.count(stmt->name) == 0;
+            if (dead) {
+                dead_.insert(stmt);
+            } else {
+                dead_.erase(stmt);
+            }
+            std::vector<const Expr*> reads;
+            collect_reads(stmt->expr, reads);
+            bool self_copy = stmt->expr->kind == ExprKind::Name && stmt->expr->text == stmt->name;
+            for (const Expr* read : reads) {
+                size_t count = 0;
+                for (const Expr* other : reads) {
+                    count += other->text == read->text;
+                }
+                bool last = count == 1 && !self_copy && (read->text == stmt->name || live.count(read->text) == 0);
+                if (last) {
+                    last_uses_.insert(read);
+                } else {
+                    last_uses_.erase(read);
+                }
+            }
+            live.erase(stmt->name);
+            // A dead store without calls is dropped, so its reads do not count.
+            if (!dead || has_call(stmt->expr)) {
+                for (const Expr* read : reads) {
+                    live.insert(read->text);
+                }
+            }
+            return;
+        }
+        case StmtKind::If: {
+            Names body = live;
+            visit_block(stmt->body, body);
+            visit_block(stmt->orelse, live);
+            live.insert(body.begin(), body.end());
+            add_reads(stmt->expr, live);
+            return;
+        }
+        case StmtKind::While:
+        case StmtKind::For: {
+            Names head = live;
+            if (stmt->kind == StmtKind::While) {
+                add_reads(stmt->expr, head);
+            }
+            for (;;) {
+                Names body = head;
+                visit_block(stmt->body, body);
+                if (stmt->kind == StmtKind::For) {
+                    body.erase(stmt->name);
+                }
+                size_t before = head.size();
+                head.insert(body.begin(), body.end());
+                if (head.size() == before) {
+                    break;
+                }
+            }
+            live = std::move(head);
+            if (stmt->kind == StmtKind::For) {
+                for (const Expr* item : stmt->args) {
+                    add_reads(item, live);
+                }
+            }
+            return;
+        }
+    }
+}
+
+// Drops dead assignments; one whose value comes from a call keeps the call
+// as an expression statement.
+void remove_dead_stores(Block& block, const Liveness& liveness) {
+    Block kept;
+    for (Stmt* stmt = block.first; stmt;) {
+        Stmt* next = stmt->next;
+        stmt->next = nullptr;
+        remove_dead_stores(stmt->body, liveness);
+        remove_dead_stores(stmt->orelse, liveness);
+        if (stmt->kind == StmtKind::Assign && liveness.is_dead(stmt)) {
+            if (has_call(stmt->expr)) {
+                stmt->kind = StmtKind::Expr;
+                kept.append(stmt);
+            }
+        } else {
+            kept.append(stmt);
+        }
+        stmt = next;
+    }
+    block = kept;
+}
+
+void remove_dead_stores(Program& program) {
+    Liveness liveness;
+    liveness.run(program);
+    remove_dead_stores(program.body, liveness);
+}
+
+// Walks the tree and streams the statements of the generated main() into
+// TranspileResult::body, already indented for the function body.
+class CppEmitter {
+public:
+    // With `source_lines` every statement reports its line through bif_line()
+    // for the --profile and --mem-stats runtimes. With `split` a large
+    // program is emitted as chunks (TranspileResult::chunks) when every
+    // variable has a concrete type.
+    TranspileResult emit_program(
+        const Program& program,
+        const std::vector<std::string_view>* source_lines = nullptr,
+        bool split = false);
+
+private:
+    void emit_tables(int depth);
+    void emit_declarations(int depth);
+    std::string declaration(std::string_view name) const;
+    bool can_split(const Program& program) const;
+    void emit_chunks(const Program& program);
+    void emit_chunk(const Stmt* first, const Stmt* end, std::string& calls);
+    void collect_names(const Stmt* first, const Stmt* end, std::vector<std::string_view>& names);
+    void collect_names(const Expr* expr, std::vector<std::string_view>& names);
+    void collect_tables(const Stmt* first, const Stmt* end = nullptr);
+    void register_table(const Stmt* stmt);
+    void emit_block(const Block& block, int depth);
+    void emit_stmt(const Stmt* stmt, int depth);
+    void emit_expr(const Expr* expr, std::string& out);
+    void emit_operand(const Expr* expr, int min_precedence, std::string& out);
+    void emit_as_double(const Expr* expr, std::string& out);
+    void emit_division(const Expr* expr, std::string& out);
+    void emit_string(std::string_view literal, std::string& out);
+    std::string& begin_line(int depth);
+    void emit_line_marker(const Stmt* stmt, int depth);
+    void emit_line_table();
+
+    TranspileResult result_;
+    TypeInference types_;
+    Liveness liveness_;
+    std::unordered_set<std::string_view> defined_;
+    // Loops over literal items share one static table per distinct item list.
+    std::unordered_map<const Stmt*, size_t> loop_tables_;
+    std::unordered_map<std::string, size_t> table_index_;
+    std::vector<std::string> tables_;
+    // Split builds: variables a chunk copies in and out, chunks already emitted.
+    std::unordered_set<std::string_view> chunk_names_;
+    std::unordered_set<std::string> chunk_functions_;
+    const std::vector<std::string_view>* source_lines_ = nullptr;
+    std::vector<int> tracked_lines_;
+};
+
+std::string& CppEmitter::begin_line(int depth) {
+    result_.body.append(static_cast<size_t>(depth) * 4, ' ');
+    return result_.body;
+}
+
+// `for` loops whose items are all literals iterate a static constexpr array
+// instead of building a container on every entry. Identical item lists (same
+// element type and spelling) map to the same table.
+void CppEmitter::collect_tables(const Stmt* first, const Stmt* end) {
+    for (const Stmt* stmt = first; stmt != end; stmt = stmt->next) {
+        if (stmt->kind == StmtKind::For) {
+            register_table(stmt);
+        }
+        collect_tables(stmt->body.first);
+        collect_tables(stmt->orelse.first);
+    }
+}
+
+void CppEmitter::register_table(const Stmt* stmt) {
+    CppType element = types_.element_type(stmt);
+    bool literal = (is_numeric(element) || element == CppType::String) && stmt->args.size > 0;
+    for (const Expr* item : stmt->args) {
+        bool negative = item->kind == ExprKind::Unary && item->op == Op::Neg && item->lhs->kind == ExprKind::Number;
+        literal = literal && (item->kind == ExprKind::Number || item->kind == ExprKind::Bool ||
+                              item->kind == ExprKind::String || negative);
+    }
+    if (!literal) {
+        return;
+    }
+    std::string table = (element == CppType::String) ? "const char*" : cpp_type_name(element);
+    table += " {";
+    for (size_t i = 0; i < stmt->args.size; ++i) {
+        if (i > 0) {
+            table += ", ";
+        }
+        emit_expr(stmt->args.items[i], table);
+    }
+    table += "}";
+    auto inserted = table_index_.emplace(table, tables_.size());
+    if (inserted.second) {
+        tables_.push_back(table);
+    }
+    loop_tables_[stmt] = inserted.first->second;
+}
+
+void CppEmitter::emit_tables(int depth) {
+    for (size_t i = 0; i < tables_.size(); ++i) {
+        const std::string& table = tables_[i];
+        size_t brace = table.find(" {");
+        std::string& out = begin_line(depth);
+        out += "static constexpr ";
+        out.append(table, 0, brace);
+        out += " bif_table_" + std::to_string(i) + "[] =";
+        out.append(table, brace);
+        out += ";\n";
+    }
+}
+
+// Variables with a concrete type are declared once at the top of main(), so
+// one assigned inside a block is still in scope after it.
+void CppEmitter::emit_declarations(int depth) {
+    emit_tables(depth);
+    for (std::string_view name : types_.assigned()) {
+        if (types_.variable_type(name) == CppType::Dynamic) {
+            continue;
+        }
+        defined_.insert(name);
+        begin_line(depth) += declaration(name) + ";\n";
+    }
+}
+
+std::string CppEmitter::declaration(std::string_view name) const {
+    CppType type = types_.variable_type(name);
+    std::string out = cpp_type_name(type);
+    out.push_back(' ');
+    out.append(name);
+    switch (type) {
+        case CppType::Bool:
+            out += " = false";
+            break;
+        case CppType::Int:
+            out += " = 0";
+            break;
+        case CppType::Double:
+            out += " = 0.0";
+            break;
+        default:
+            break;
+    }
+    return out;
+}
+
+void CppEmitter::emit_as_double(const Expr* expr, std::string& out) {
+    CppType type = types_.type_of(expr);
+    if (type == CppType::Double) {
+        emit_operand(expr, 12, out);
+    } else if (expr->kind == ExprKind::Number) {
+        out.append(expr->text);
+        out += ".0";
+    } else {
+        out += "static_cast<double>(";
+        emit_expr(expr, out);
+        out.push_back(')');
+    }
+}
+
+// `/` is true division: when neither operand is already a double the left
+// one is converted, and nothing else in the expression is touched.
+void CppEmitter::emit_division(const Expr* expr, std::string& out) {
+    if (types_.type_of(expr->rhs) == CppType::Double) {
+        emit_operand(expr->lhs, 12, out);
+    } else {
+        emit_as_double(expr->lhs, out);
+    }
+    out += " / ";
+    emit_operand(expr->rhs, 13, out);
+}
+
+void CppEmitter::emit_string(std::string_view literal, std::string& out) {
+    if (literal.front() == '"') {
+        out.append(literal);
+        return;
+    }
+    out.push_back('"');
+    for (size_t i = 1; i + 1 < literal.size(); ++i) {
+        char ch = literal[i];
+        if (ch == '\\' && i + 2 < literal.size() && literal[i + 1] == '\'') {
+            out.push_back('\'');
+            ++i;
+        } else if (ch == '\\') {
+            out.push_back(ch);
+            out.push_back(literal[++i]);
+        } else if (ch == '"') {
+            out += "\\\"";
+        } else {
+            out.push_back(ch);
+        }
+    }
+    out.push_back('"');
+}
+
+void CppEmitter::emit_operand(const Expr* expr, int min_precedence, std::string& out) {
+    if (cpp_precedence(expr) < min_precedence) {
+        out.push_back('(');
+        emit_expr(expr, out);
+        out.push_back(')');
+    } else {
+        emit_expr(expr, out);
+    }
+}
+
+void CppEmitter::emit_expr(const Expr* expr, std::string& out) {
+    switch (expr->kind) {
+        case ExprKind::Name: {
+            if (!expr->module.empty()) {
+                out.append(expr->module);
+                out += "::";
+            }
+            CppType type = expr->module.empty() ? types_.variable_type(expr->text) : CppType::Unknown;
+            bool movable = type == CppType::String || type == CppType::IntList || type == CppType::StringList;
+            if (movable && liveness_.is_last_use(expr)) {
+                out += "std::move(";
+                out.append(expr->text);
+                out.push_back(')');
+                return;
+            }
+            out.append(expr->text);
+            return;
+        }
+        case ExprKind::Number:
+            out.append(expr->text);
+            return;
+        case ExprKind::String:
+            emit_string(expr->text, out);
+            return;
+        case ExprKind::Bool:
+            out += expr->bool_value ? "true" : "false";
+            return;
+        case ExprKind::None:
+            out += "nullptr";
+            return;
+        case ExprKind::Unary:
+            out += cpp_operator(expr->op);
+            if (expr->lhs->kind == ExprKind::Unary) {
+                out.push_back('(');
+                emit_expr(expr->lhs, out);
+                out.push_back(')');
+            } else {
+                emit_operand(expr->lhs, 14, out);
+            }
+            return;
+        case ExprKind::Binary: {
+            bool integral = types_.type_of(expr) == CppType::Int;
+            bool integral_op = expr->op == Op::Pow || expr->op == Op::FloorDiv || expr->op == Op::Mod;
+            if (integral_op && integral) {
+                out += (expr->op == Op::Pow)        ? "bif_int_pow("
+                       : (expr->op == Op::FloorDiv) ? "bif_floor_div("
+                                                    : "bif_floor_mod(";
+                emit_expr(expr->lhs, out);
+                out += ", ";
+                emit_expr(expr->rhs, out);
+                out.push_back(')');
+                return;
+            }
+            bool float_mod = expr->op == Op::Mod && types_.type_of(expr) == CppType::Double;
+            if (expr->op == Op::Pow || expr->op == Op::FloorDiv || float_mod) {
+                result_.uses_cmath = true;
+                if (expr->op == Op::FloorDiv) {
+                    out += "std::floor(";
+                    emit_division(expr, out);
+                } else {
+                    out += (expr->op == Op::Pow) ? "std::pow(" : "bif_float_mod(";
+                    emit_expr(expr->lhs, out);
+                    out += ", ";
+                    emit_expr(expr->rhs, out);
+                }
+                out.push_back(')');
+                return;
+            }
+            if (expr->op == Op::Div) {
+                emit_division(expr, out);
+                return;
+            }
+            if (expr->op == Op::Add && expr->lhs->kind == ExprKind::String &&
+                types_.type_of(expr->rhs) == CppType::String) {
+                out += "std::string(";
+                emit_string(expr->lhs->text, out);
+                out.push_back(')');
+                out += cpp_operator(expr->op);
+                emit_operand(expr->rhs, cpp_precedence(expr) + 1, out);
+                return;
+            }
+            emit_operand(expr->lhs, cpp_precedence(expr), out);
+            out += cpp_operator(expr->op);
+            emit_operand(expr->rhs, cpp_precedence(expr) + 1, out);
+            return;
+        }
+        case ExprKind::Call: {
+            const Expr* callee = expr->lhs;
+            bool is_input = is_builtin_call(expr, "input");
+            bool is_number = expr->args.size == 1 && (is_builtin_call(expr, "int") || is_builtin_call(expr, "float"));
+            if (is_number && is_builtin_call(expr->args.items[0], "input")) {
+                // int(input()) parses the line where it was read, no std::string in between.
+                const Expr* input = expr->args.items[0];
+                out += callee->text == "int" ? "bif_input_int(" : "bif_input_float(";
+                if (input->args.size > 0) {
+                    emit_expr(input->args.items[0], out);
+                } else {
+                    out += "\"\"";
+                }
+                out.push_back(')');
+                return;
+            }
+            if (is_input) {
+                out += "bif_input";
+            } else if (is_number) {
+                out += callee->text == "int" ? "bif_int" : "bif_float";
+            } else if (is_builtin_call(expr, "input_lines")) {
+                out += "bif_input_lines";
+            } else {
+                emit_operand(callee, 16, out);
+            }
+            out.push_back('(');
+            for (size_t i = 0; i < expr->args.size; ++i) {
+                if (i > 0) {
+                    out += ", ";
+                }
+                emit_expr(expr->args.items[i], out);
+            }
+            if (is_input && expr->args.size == 0) {
+                out += "\"\"";
+            }
+            out.push_back(')');
+            return;
+        }
+        case ExprKind::Attribute:
+            emit_operand(expr->lhs, 16, out);
+            out.push_back('.');
+            out.append(expr->text);
+            return;
+    }
+}
+
+void CppEmitter::emit_block(const Block& block, int depth) {
+    for (const Stmt* stmt = block.first; stmt; stmt = stmt->next) {
+        emit_stmt(stmt, depth);
+    }
+}
+
+void CppEmitter::emit_line_marker(const Stmt* stmt, int depth) {
+    if (source_lines_) {
+        begin_line(depth) += "bif_line(" + std::to_string(stmt->line) + ");\n";
+    }
+}
+
+void CppEmitter::emit_stmt(const Stmt* stmt, int depth) {
+    if (source_lines_) {
+        tracked_lines_.push_back(stmt->line);
+        if (stmt->kind != StmtKind::If && stmt->kind != StmtKind::While) {
+            emit_line_marker(stmt, depth);
+        }
+    }
+    std::string& out = begin_line(depth);
+    switch (stmt->kind) {
+        case StmtKind::Print:
+            out += "bif_print(";
+            for (size_t i = 0; i < stmt->args.size; ++i) {
+                if (i > 0) {
+                    out += ", ";
+                }
+                emit_expr(stmt->args.items[i], out);
+            }
+            out += ");\n";
+            return;
+        case StmtKind::Assign:
+            if (defined_.insert(stmt->name).second) {
+                out += "auto ";
+            }
+            out.append(stmt->name);
+            out += " = ";
+            emit_expr(stmt->expr, out);
+            out += ";\n";
+            return;
+        case StmtKind::Expr:
+            emit_expr(stmt->expr, out);
+            out += ";\n";
+            return;
+        case StmtKind::If:
+        case StmtKind::While:
+            out += (stmt->kind == StmtKind::If) ? "if (" : "while (";
+            if (source_lines_) {
+                // Entered on every evaluation of the condition.
+                out += "(bif_line(" + std::to_string(stmt->line) + "), ";
+                emit_expr(stmt->expr, out);
+                out.push_back(')');
+            } else {
+                emit_expr(stmt->expr, out);
+            }
+            out += ") {\n";
+            emit_block(stmt->body, depth + 1);
+            if (stmt->has_else) {
+                begin_line(depth) += "} else {\n";
+                emit_block(stmt->orelse, depth + 1);
+            }
+            begin_line(depth) += "}\n";
+            return;
+        case StmtKind::For: {
+            CppType element = types_.element_type(stmt);
+            // A typed target is declared with the other variables, so the
+            // loop walks a hidden item and assigns it; an `auto` one is
+            // local to the loop.
+            bool hoisted = defined_.count(stmt->name) != 0;
+            out += "for (";
+            if (hoisted) {
+                out += "auto&& bif_item";
+            } else {
+                out += cpp_type_name(types_.variable_type(stmt->name));
+                out.push_back(' ');
+                out.append(stmt->name);
+            }
+            out += " : ";
+            CppType iterable = stmt->args.size == 1 ? types_.type_of(stmt->args.items[0]) : CppType::Unknown;
+            auto table = loop_tables_.find(stmt);
+            if (table != loop_tables_.end()) {
+                out += "bif_table_" + std::to_string(table->second);
+            } else if (iterable == CppType::IntList || iterable == CppType::StringList) {
+                emit_expr(stmt->args.items[0], out);
+            } else if (is_numeric(element) || element == CppType::String) {
+                // Items that are not all literals still live on the stack.
+                const char* element_name = cpp_type_name(element);
+                out += "std::initializer_list<";
+                out += element_name;
+                out += ">{";
+                for (size_t i = 0; i < stmt->args.size; ++i) {
+                    if (i > 0) {
+                        out += ", ";
+                    }
+                    // Brace initialization rejects narrowing from variables.
+                    const Expr* item = stmt->args.items[i];
+                    bool convert = item->kind != ExprKind::Number && is_numeric(element) && types_.type_of(item) != element;
+                    if (convert) {
+                        out += "static_cast<";
+                        out += element_name;
+                        out += ">(";
+                    }
+                    emit_expr(item, out);
+                    if (convert) {
+                        out.push_back(')');
+                    }
+                }
+                out.push_back('}');
+            } else {
+                out += "std::vector<double>{";
+                for (size_t i = 0; i < stmt->args.size; ++i) {
+                    if (i > 0) {
+                        out += ", ";
+                    }
+                    emit_expr(stmt->args.items[i], out);
+                }
+                out.push_back('}');
+            }
+            out += ") {\n";
+            emit_line_marker(stmt, depth + 1);
+            if (hoisted) {
+                begin_line(depth + 1).append(stmt->name) += " = bif_item;\n";
+            }
+            emit_block(stmt->body, depth + 1);
+            begin_line(depth) += "}\n";
+            return;
+        }
+    }
+}
+
+TranspileResult CppEmitter::emit_program(
+    const Program& program,
+    const std::vector<std::string_view>* source_lines,
+    bool split) {
+    result_ = TranspileResult();
+    source_lines_ = source_lines;
+    tracked_lines_.clear();
+    defined_.clear();
+    loop_tables_.clear();
+    table_index_.clear();
+    tables_.clear();
+    chunk_functions_.clear();
+    {
+        TraceScope trace("infer types");
+        types_.run(program);
+    }
+    {
+        TraceScope trace("liveness");
+        liveness_.run(program);
+    }
+    TraceScope trace("emit C++");
+    if (split && can_split(program)) {
+        emit_chunks(program);
+    } else {
+        collect_tables(program.body.first);
+        emit_declarations(1);
+        emit_block(program.body, 1);
+    }
+    result_.imports = program.imports;
+    if (source_lines_) {
+        emit_line_table();
+    }
+    return std::move(result_);
+}
+
+// Chunk boundaries are content-defined: a chunk closes after a top-level
+// statement once it spans kChunkMinLines and the statement's fingerprint is
+// a multiple of kChunkSpread, or at kChunkMaxLines regardless. An edit then
+// moves at most the boundaries next to it, and the chunks after it keep
+// their text and their compiled objects.
+constexpr int kSplitMinLines = 2000;
+constexpr int kChunkMinLines = 150;
+constexpr int kChunkMaxLines = 600;
+constexpr uint64_t kChunkSpread = 8;
+
+uint64_t statement_fingerprint(const Stmt* stmt) {
+    ContentHash hash;
+    hash.update(stmt->name);
+    std::vector<const Expr*> pending;
+    if (stmt->expr) {
+        pending.push_back(stmt->expr);
+    }
+    for (const Expr* arg : stmt->args) {
+        pending.push_back(arg);
+    }
+    while (!pending.empty()) {
+        const Expr* expr = pending.back();
+        pending.pop_back();
+        hash.update(expr->text);
+        for (const Expr* child : {expr->lhs, expr->rhs}) {
+            if (child) {
+                pending.push_back(child);
+            }
+        }
+        for (const Expr* arg : expr->args) {
+            pending.push_back(arg);
+        }
+    }
+    return hash.value();
+}
+
+// Chunks share variables through namespace bif_vars, which needs a type for
+// every one of them; `auto` variables keep the program in one piece.
+bool CppEmitter::can_split(const Program& program) const {
+    if (!program.body.first || program.body.last->line - program.body.first->line < kSplitMinLines) {
+        return false;
+    }
+    for (std::string_view name : types_.assigned()) {
+        if (types_.variable_type(name) == CppType::Dynamic) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void CppEmitter::emit_chunks(const Program& program) {
+    std::string& globals = result_.globals;
+    globals += "namespace bif_vars {\n";
+    for (std::string_view name : types_.assigned()) {
+        defined_.insert(name);
+        globals += declaration(name) + ";\n";
+    }
+    globals += "}\n\n";
+
+    std::string calls;
+    const Stmt* first = program.body.first;
+    while (first) {
+        const Stmt* last = first;
+        while (last->next) {
+            int span = last->next->line - first->line;
+            if (span >= kChunkMaxLines || (span >= kChunkMinLines && statement_fingerprint(last) % kChunkSpread == 0)) {
+                break;
+            }
+            last = last->next;
+        }
+        emit_chunk(first, last->next, calls);
+        first = last->next;
+    }
+    result_.body = std::move(calls);
+}
+
+// One chunk: the statements [first, end) in a function of their own. The
+// variables they use are copied into locals on entry and back on exit, so
+// the optimizer sees the same locals it would in main().
+void CppEmitter::emit_chunk(const Stmt* first, const Stmt* end, std::string& calls) {
+    loop_tables_.clear();
+    table_index_.clear();
+    tables_.clear();
+    collect_tables(first, end);
+    std::vector<std::string_view> names;
+    chunk_names_.clear();
+    collect_names(first, end, names);
+
+    result_.body.clear();
+    emit_tables(1);
+    std::string externs;
+    for (std::string_view name : names) {
+        CppType type = types_.variable_type(name);
+        bool movable = type == CppType::String || type == CppType::IntList || type == CppType::StringList;
+        std::string variable(name);
+        externs += "extern " + std::string(cpp_type_name(type)) + " " + variable + ";\n";
+        begin_line(1) += cpp_type_name(type) + (" " + variable) +
+                         (movable ? " = std::move(bif_vars::" + variable + ");\n" : " = bif_vars::" + variable + ";\n");
+    }
+    for (const Stmt* stmt = first; stmt != end; stmt = stmt->next) {
+        emit_stmt(stmt, 1);
+    }
+    for (std::string_view name : names) {
+        std::string variable(name);
+        begin_line(1) += "bif_vars::" + variable + " = std::move(" + variable + ");\n";
+    }
+
+    std::string text = "namespace bif_vars {\n" + externs + "}\n\n";
+    ContentHash hash;
+    hash.update(text);
+    hash.update(result_.body);
+    std::string function = "bif_chunk_" + hash.hex();
+    calls += "    " + function + "();\n";
+    if (!chunk_functions_.insert(function).second) {
+        return;
+    }
+    text += "void " + function + "() {\n" + result_.body + "}\n";
+    result_.chunks.push_back(std::move(text));
+    result_.globals += "void " + function + "();\n";
+}
+
+void CppEmitter::collect_names(const Stmt* first, const Stmt* end, std::vector<std::string_view>& names) {
+    for (const Stmt* stmt = first; stmt != end; stmt = stmt->next) {
+        bool target = stmt->kind == StmtKind::Assign || stmt->kind == StmtKind::For;
+        if (target && defined_.count(stmt->name) && chunk_names_.insert(stmt->name).second) {
+            names.push_back(stmt->name);
+        }
+        if (stmt->expr) {
+            collect_names(stmt->expr, names);
+        }
+        for (const Expr* arg : stmt->args) {
+            collect_names(arg, names);
+        }
+        collect_names(stmt->body.first, nullptr, names);
+        collect_names(stmt->orelse.first, nullptr, names);
+    }
+}
+
+void CppEmitter::collect_names(const Expr* expr, std::vector<std::string_view>& names) {
+    if (expr->kind == ExprKind::Name && expr->module.empty() && defined_.count(expr->text) &&
+        chunk_names_.insert(expr->text).second) {
+        names.push_back(expr->text);
+    }
+    for (const Expr* child : {expr->lhs, expr->rhs}) {
+        if (child) {
+            collect_names(child, names);
+        }
+    }
+    for (const Expr* arg : expr->args) {
+        collect_names(arg, names);
+    }
+}
+
+// Source text of every instrumented line, for the reports.
+void CppEmitter::emit_line_table() {
+    std::sort(tracked_lines_.begin(), tracked_lines_.end());
+    tracked_lines_.erase(std::unique(tracked_lines_.begin(), tracked_lines_.end()), tracked_lines_.end());
+    std::string& out = result_.line_table;
+    out += "constexpr BifSourceLine bif_source_lines[] = {\n";
+    for (int line : tracked_lines_) {
+        std::string_view text = (*source_lines_)[static_cast<size_t>(line - 1)];
+        size_t first = text.find_first_not_of(" \t");
+        size_t last = text.find_last_not_of(" \t\r");
+        text = first == std::string_view::npos ? std::string_view() : text.substr(first, last - first + 1);
+        out += "    {" + std::to_string(line) + ", \"";
+        for (char ch : text) {
+            unsigned char byte = static_cast<unsigned char>(ch);
+            if (ch == '\\' || ch == '"') {
+                out.push_back('\\');
+                out.push_back(ch);
+            } else if (byte < 0x20 || byte == 0x7f) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\%03o", byte);
+                out += escaped;
+            } else {
+                out.push_back(ch);
+            }
+        }
+        out += "\"},\n";
+    }
+    out += "    {0, \"\"},\n";
+    out += "};\n";
+    int max_line = tracked_lines_.empty() ? 0 : tracked_lines_.back();
+    out += "constexpr int bif_max_line = " + std::to_string(max_line) + ";\n";
+}
+
+struct RuntimeError {
+    std::string message;
+};
+
+enum class ValueType : uint8_t {
+    None,
+    Bool,
+    Int,
+    Double,
+    String,
+    List,
+};
+
+struct Value;
+using ValueList = std::vector<Value>;
+
+// A VM register. Bool and Int share `i`; strings and lists are only touched
+// when `type` says so, so numeric code never pays for them.
+struct Value {
+    ValueType type = ValueType::None;
+    int64_t i = 0;
+    double d = 0.0;
+    std::string s;
+    std::shared_ptr<const ValueList> list;
+};
+
+Value make_int(int64_t value) {
+    Value out;
+    out.type = ValueType::Int;
+    out.i = value;
+    return out;
+}
+
+Value make_double(double value) {
+    Value out;
+    out.type = ValueType::Double;
+    out.d = value;
+    return out;
+}
+
+Value make_bool(bool value) {
+    Value out;
+    out.type = ValueType::Bool;
+    out.i = value ? 1 : 0;
+    return out;
+}
+
+Value make_string(std::string value) {
+    Value out;
+    out.type = ValueType::String;
+    out.s = std::move(value);
+    return out;
+}
+
+Value make_list(ValueList items) {
+    Value out;
+    out.type = ValueType::List;
+    out.list = std::make_shared<const ValueList>(std::move(items));
+    return out;
+}
+
+inline void copy_value(Value& dst, const Value& src) {
+    dst.type = src.type;
+    dst.i = src.i;
+    dst.d = src.d;
+    if (src.type == ValueType::String) {
+        dst.s = src.s;
+    } else if (src.type == ValueType::List) {
+        dst.list = src.list;
+    }
+}
+
+inline void set_int(Value& dst, int64_t value) {
+    dst.type = ValueType::Int;
+    dst.i = value;
+}
+
+inline void set_double(Value& dst, double value) {
+    dst.type = ValueType::Double;
+    dst.d = value;
+}
+
+inline void set_bool(Value& dst, bool value) {
+    dst.type = ValueType::Bool;
+    dst.i = value ? 1 : 0;
+}
+
+bool is_number(const Value& value) {
+    return value.type == ValueType::Int || value.type == ValueType::Double || value.type == ValueType::Bool;
+}
+
+double as_double(const Value& value) {
+    return value.type == ValueType::Double ? value.d : static_cast<double>(value.i);
+}
+
+int64_t as_int(const Value& value) {
+    return value.type == ValueType::Double ? static_cast<int64_t>(value.d) : value.i;
+}
+
+bool truthy(const Value& value) {
+    switch (value.type) {
+        case ValueType::None:
+            return false;
+        case ValueType::Bool:
+        case ValueType::Int:
+            return value.i != 0;
+        case ValueType::Double:
+            return value.d != 0.0;
+        case ValueType::String:
+            return !value.s.empty();
+        case ValueType::List:
+            return !value.list->empty();
+    }
+    return false;
+}
+
+const char* type_name(const Value& value) {
+    switch (value.type) {
+        case ValueType::None:
+            return "None";
+        case ValueType::Bool:
+            return "bool";
+        case ValueType::Int:
+            return "int";
+        case ValueType::Double:
+            return "float";
+        case ValueType::String:
+            return "str";
+        case ValueType::List:
+            return "list";
+    }
+    return "?";
+}
+
+// Same text as bif_format_double in the generated runtime; `text` holds 32 chars.
+char* format_double(char* text, double value) {
+    if (value != value) {
+        std::memcpy(text, "nan", 3);
+        return text + 3;
+    }
+    char* end = std::to_chars(text, text + 32, value, std::chars_format::scientific).ptr;
+    const char* mark = std::find(text, end, 'e');
+    if (mark == end) {
+        return end;
+    }
+    int exponent = 0;
+    for (const char* digit = mark + 2; digit < end; ++digit) {
+        exponent = exponent * 10 + (*digit - '0');
+    }
+    if (mark[1] == '-') {
+        exponent = -exponent;
+    }
+    if (exponent < -4 || exponent >= 16) {
+        return end;
+    }
+    end = std::to_chars(text, text + 32, value, std::chars_format::fixed).ptr;
+    if (std::find(text, end, '.') == end) {
+        std::memcpy(end, ".0", 2);
+        end += 2;
+    }
+    return end;
+}
+
+// Formats like the compiled program's bif_write (bools print as 1/0).
+void write_value(std::ostream& out, const Value& value) {
+    switch (value.type) {
+        case ValueType::None:
+            out << "None";
+            return;
+        case ValueType::Bool:
+        case ValueType::Int:
+            out << value.i;
+            return;
+        case ValueType::Double: {
+            char text[32];
+            out.write(text, format_double(text, value.d) - text);
+            return;
+        }
+        case ValueType::String:
+            out << value.s;
+            return;
+        case ValueType::List:
+            out << '[';
+            for (size_t i = 0; i < value.list->size(); ++i) {
+                if (i > 0) {
+                    out << ", ";
+                }
+                write_value(out, (*value.list)[i]);
+            }
+            out << ']';
+            return;
+    }
+}
+
+// A `for` list with any double in it iterates doubles only, like the compiled
+// table whose element type is joined over all items.
+void promote_loop_items(ValueList& items) {
+    bool has_double = std::any_of(items.begin(), items.end(),
+                                  [](const Value& item) { return item.type == ValueType::Double; });
+    if (!has_double) {
+        return;
+    }
+    for (Value& item : items) {
+        if (is_number(item)) {
+            item = make_double(as_double(item));
+        }
+    }
+}
+
+[[noreturn]] void fail_operands(const char* symbol, const Value& lhs, const Value& rhs) {
+    throw RuntimeError{std::string("Unsupported operand types for ") + symbol + ": '" + type_name(lhs) + "' and '" +
+                       type_name(rhs) + "'."};
+}
+
+// Same results as bif_floor_div, bif_floor_mod, bif_float_mod and
+// bif_int_pow in the generated runtime.
+int64_t floor_div(int64_t lhs, int64_t rhs) {
+    int64_t quotient = lhs / rhs;
+    return (lhs % rhs != 0 && (lhs < 0) != (rhs < 0)) ? quotient - 1 : quotient;
+}
+
+int64_t floor_mod(int64_t lhs, int64_t rhs) {
+    int64_t rest = lhs % rhs;
+    return (rest != 0 && (rest < 0) != (rhs < 0)) ? rest + rhs : rest;
+}
+
+double float_mod(double lhs, double rhs) {
+    double rest = std::fmod(lhs, rhs);
+    if (rest == 0.0) {
+        return std::copysign(0.0, rhs);
+    }
+    return ((rest < 0.0) != (rhs < 0.0)) ? rest + rhs : rest;
+}
+
+int64_t int_pow(int64_t base, int64_t exponent) {
+    uint64_t result = 1;
+    uint64_t factor = static_cast<uint64_t>(base);
+    for (; exponent > 0; exponent >>= 1) {
+        if (exponent & 1) {
+            result *= factor;
+        }
+        factor *= factor;
+    }
+    return static_cast<int64_t>(result);
+}
+
+void arithmetic(Op op, const Value& lhs, const Value& rhs, Value& out) {
+    static const char* const symbols[] = {"or", "and", "not", "==", "!=", "<", "<=", ">", ">=",
+                                          "+",  "-",   "*",   "/",  "//", "%", "**", "-", "+"};
+    const char* symbol = symbols[static_cast<size_t>(op)];
+    if (op == Op::Add && lhs.type == ValueType::String && rhs.type == ValueType::String) {
+        std::string joined;
+        joined.reserve(lhs.s.size() + rhs.s.size());
+        joined += lhs.s;
+        joined += rhs.s;
+        out.type = ValueType::String;
+        out.s = std::move(joined);
+        return;
+    }
+    if (!is_number(lhs) || !is_number(rhs)) {
+        fail_operands(symbol, lhs, rhs);
+    }
+
+    bool integral = lhs.type != ValueType::Double && rhs.type != ValueType::Double;
+    switch (op) {
+        case Op::Add:
+            integral ? set_int(out, lhs.i + rhs.i) : set_double(out, as_double(lhs) + as_double(rhs));
+            return;
+        case Op::Sub:
+            integral ? set_int(out, lhs.i - rhs.i) : set_double(out, as_double(lhs) - as_double(rhs));
+            return;
+        case Op::Mul:
+            integral ? set_int(out, lhs.i * rhs.i) : set_double(out, as_double(lhs) * as_double(rhs));
+            return;
+        case Op::Div:
+            set_double(out, as_double(lhs) / as_double(rhs));
+            return;
+        case Op::FloorDiv:
+            if (integral) {
+                if (rhs.i == 0) {
+                    throw RuntimeError{"Integer division by zero."};
+                }
+                set_int(out, floor_div(lhs.i, rhs.i));
+            } else {
+                set_double(out, std::floor(as_double(lhs) / as_double(rhs)));
+            }
+            return;
+        case Op::Mod:
+            if (integral) {
+                if (rhs.i == 0) {
+                    throw RuntimeError{"Integer modulo by zero."};
+                }
+                set_int(out, floor_mod(lhs.i, rhs.i));
+            } else {
+                set_double(out, float_mod(as_double(lhs), as_double(rhs)));
+            }
+            return;
+        case Op::Pow:
+            if (integral && rhs.i >= 0) {
+                set_int(out, int_pow(lhs.i, rhs.i));
+            } else {
+                set_double(out, std::pow(as_double(lhs), as_double(rhs)));
+            }
+            return;
+        default:
+            fail_operands(symbol, lhs, rhs);
+    }
+}
+
+bool compare(Op op, const Value& lhs, const Value& rhs) {
+    int order;
+    if (is_number(lhs) && is_number(rhs)) {
+        if (lhs.type != ValueType::Double && rhs.type != ValueType::Double) {
+            order = (lhs.i < rhs.i) ? -1 : (lhs.i > rhs.i ? 1 : 0);
+        } else {
+            double l = as_double(lhs);
+            double r = as_double(rhs);
+            if (l != l || r != r) {
+                return op == Op::Ne;
+            }
+            order = (l < r) ? -1 : (l > r ? 1 : 0);
+        }
+    } else if (lhs.type == ValueType::String && rhs.type == ValueType::String) {
+        order = lhs.s.compare(rhs.s);
+    } else if (op == Op::Eq || op == Op::Ne) {
+        bool equal = lhs.type == ValueType::None && rhs.type == ValueType::None;
+        return (op == Op::Eq) == equal;
+    } else {
+        static const char* const symbols[] = {"<", "<=", ">", ">="};
+        fail_operands(symbols[static_cast<size_t>(op) - static_cast<size_t>(Op::Lt)], lhs, rhs);
+    }
+
+    switch (op) {
+        case Op::Eq:
+            return order == 0;
+        case Op::Ne:
+            return order != 0;
+        case Op::Lt:
+            return order < 0;
+        case Op::Le:
+            return order <= 0;
+        case Op::Gt:
+            return order > 0;
+        default:
+            return order >= 0;
+    }
+}
+
+enum class NativeId : uint8_t {
+    Sqrt,
+    Pow,
+    Abs,
+    Floor,
+    Ceil,
+    Sin,
+    Cos,
+    Tan,
+    Range,
+    RangeStep,
+    Repeat,
+    Count,
+    Cycle,
+    Chain,
+    Int,
+    Float,
+    InputLines,
+};
+
+struct NativeFunction {
+    std::string_view module;
+    std::string_view name;
+    uint32_t arity;
+    NativeId id;
+};
+
+const std::vector<NativeFunction>& native_functions() {
+    static const std::vector<NativeFunction> functions = {
+        {"BIFMath", "sqrt", 1, NativeId::Sqrt},
+        {"BIFMath", "pow", 2, NativeId::Pow},
+        {"BIFMath", "abs", 1, NativeId::Abs},
+        {"BIFMath", "floor", 1, NativeId::Floor},
+        {"BIFMath", "ceil", 1, NativeId::Ceil},
+        {"BIFMath", "sin", 1, NativeId::Sin},
+        {"BIFMath", "cos", 1, NativeId::Cos},
+        {"BIFMath", "tan", 1, NativeId::Tan},
+        {"BIFitertools", "range", 1, NativeId::Range},
+        {"BIFitertools", "range", 3, NativeId::RangeStep},
+        {"BIFitertools", "repeat", 2, NativeId::Repeat},
+        {"BIFitertools", "count", 3, NativeId::Count},
+        {"BIFitertools", "cycle", 2, NativeId::Cycle},
+        {"BIFitertools", "chain", 2, NativeId::Chain},
+        {"", "int", 1, NativeId::Int},
+        {"", "float", 1, NativeId::Float},
+        {"", "input_lines", 0, NativeId::InputLines},
+    };
+    return functions;
+}
+
+std::string native_label(const NativeFunction& fn) {
+    if (fn.module.empty()) {
+        return std::string(fn.name) + "()";
+    }
+    return std::string(fn.module) + "." + std::string(fn.name) + "()";
+}
+
+// Number of int()/float() from a string, with the whitespace and sign rules
+// of the generated runtime's bif_parse_int / bif_parse_float.
+template <typename T>
+bool parse_number(std::string_view text, T& value) {
+    const char* space = " \t\n\r\f\v";
+    size_t first = text.find_first_not_of(space);
+    if (first == std::string_view::npos) {
+        return false;
+    }
+    text = text.substr(first, text.find_last_not_of(space) - first + 1);
+    if (text.size() > 1 && text[0] == '+' && text[1] != '-') {
+        text.remove_prefix(1);
+    }
+    auto parsed = std::from_chars(text.data(), text.data() + text.size(), value);
+    return parsed.ec == std::errc() && parsed.ptr == text.data() + text.size();
+}
+
+double native_double(const NativeFunction& fn, const Value& arg) {
+    if (!is_number(arg)) {
+        throw RuntimeError{native_label(fn) + " expects a number, got '" + type_name(arg) + "'."};
+    }
+    return as_double(arg);
+}
+
+int native_int(const NativeFunction& fn, const Value& arg) {
+    if (!is_number(arg)) {
+        throw RuntimeError{native_label(fn) + " expects a number, got '" + type_name(arg) + "'."};
+    }
+    return static_cast<int>(as_int(arg));
+}
+
+std::vector<int> native_int_list(const NativeFunction& fn, const Value& arg) {
+    if (arg.type != ValueType::List) {
+        throw RuntimeError{native_label(fn) + " expects a list, got '" + type_name(arg) + "'."};
+    }
+    std::vector<int> out;
+    out.reserve(arg.list->size());
+    for (const Value& item : *arg.list) {
+        out.push_back(native_int(fn, item));
+    }
+    return out;
+}
+
+Value from_int_list(const std::vector<int>& items) {
+    ValueList out;
+    out.reserve(items.size());
+    for (int item : items) {
+        out.push_back(make_int(item));
+    }
+    return make_list(std::move(out));
+}
+
+void call_native(const NativeFunction& fn, const Value* args, Value& out) {
+    using bif::itertools::BIFitertools;
+    using bif::math::BIFMath;
+    switch (fn.id) {
+        case NativeId::Sqrt:
+            set_double(out, BIFMath::sqrt(native_double(fn, args[0])));
+            return;
+        case NativeId::Pow:
+            set_double(out, BIFMath::pow(native_double(fn, args[0]), native_double(fn, args[1])));
+            return;
+        case NativeId::Abs:
+            set_double(out, BIFMath::abs(native_double(fn, args[0])));
+            return;
+        case NativeId::Floor:
+            set_double(out, BIFMath::floor(native_double(fn, args[0])));
+            return;
+        case NativeId::Ceil:
+            set_double(out, BIFMath::ceil(native_double(fn, args[0])));
+            return;
+        case NativeId::Sin:
+            set_double(out, BIFMath::sin(native_double(fn, args[0])));
+            return;
+        case NativeId::Cos:
+            set_double(out, BIFMath::cos(native_double(fn, args[0])));
+            return;
+        case NativeId::Tan:
+            set_double(out, BIFMath::tan(native_double(fn, args[0])));
+            return;
+        case NativeId::Range:
+            out = from_int_list(BIFitertools::range(native_int(fn, args[0])));
+            return;
+        case NativeId::RangeStep:
+            out = from_int_list(
+                BIFitertools::range(native_int(fn, args[0]), native_int(fn, args[1]), native_int(fn, args[2])));
+            return;
+        case NativeId::Repeat: {
+            if (args[0].type != ValueType::String) {
+                throw RuntimeError{native_label(fn) + " expects a string, got '" + type_name(args[0]) + "'."};
+            }
+            ValueList items;
+            for (const std::string& item : BIFitertools::repeat(args[0].s, native_int(fn, args[1]))) {
+                items.push_back(make_string(item));
+            }
+            out = make_list(std::move(items));
+            return;
+        }
+        case NativeId::Count:
+            out = from_int_list(
+                BIFitertools::count(native_int(fn, args[0]), native_int(fn, args[1]), native_int(fn, args[2])));
+            return;
+        case NativeId::Cycle:
+            out = from_int_list(BIFitertools::cycle(native_int_list(fn, args[0]), native_int(fn, args[1])));
+            return;
+        case NativeId::Chain:
+            out = from_int_list(BIFitertools::chain(native_int_list(fn, args[0]), native_int_list(fn, args[1])));
+            return;
+        case NativeId::Int: {
+            int64_t value = 0;
+            if (args[0].type == ValueType::String) {
+                if (!parse_number(args[0].s, value)) {
+                    throw RuntimeError{"ValueError: invalid literal for int() with base 10: '" + args[0].s + "'"};
+                }
+            } else if (args[0].type == ValueType::Double) {
+                value = static_cast<int64_t>(args[0].d);
+            } else if (is_number(args[0])) {
+                value = args[0].i;
+            } else {
+                throw RuntimeError{native_label(fn) + " expects a number or a string, got '" + type_name(args[0]) + "'."};
+            }
+            out = make_int(value);
+            return;
+        }
+        case NativeId::Float: {
+            double value = 0.0;
+            if (args[0].type == ValueType::String) {
+                if (!parse_number(args[0].s, value)) {
+                    throw RuntimeError{"ValueError: could not convert string to float: '" + args[0].s + "'"};
+                }
+            } else {
+                value = native_double(fn, args[0]);
+            }
+            set_double(out, value);
+            return;
+        }
+        case NativeId::InputLines: {
+            std::cout.flush();
+            ValueList items;
+            std::string line;
+            while (std::getline(std::cin, line)) {
+                if (!line.empty() && line.back() == '\r') {
+                    line.pop_back();
+                }
+                items.push_back(make_string(std::move(line)));
+            }
+            out = make_list(std::move(items));
+            return;
+        }
+    }
+}
+
+std::string unescape_string(std::string_view literal) {
+    std::string out;
+    out.reserve(literal.size());
+    for (size_t i = 1; i + 1 < literal.size(); ++i) {
+        char ch = literal[i];
+        if (ch != '\\' || i + 2 >= literal.size()) {
+            out.push_back(ch);
+            continue;
+        }
+        char next = literal[++i];
+        switch (next) {
+            case 'n':
+                out.push_back('\n');
+                break;
+            case 't':
+                out.push_back('\t');
+                break;
+            case 'r':
+                out.push_back('\r');
+                break;
+            case '0':
+                out.push_back('\0');
+                break;
+            case '\\':
+            case '\'':
+            case '"':
+                out.push_back(next);
+                break;
+            default:
+                out.push_back('\\');
+                out.push_back(next);
+                break;
+        }
+    }
+    return out;
+}
+
+// Value of a literal expression; false for anything else.
+bool literal_value(const Expr* expr, Value& out) {
+    switch (expr->kind) {
+        case ExprKind::Number: {
+            std::string text(expr->text);
+            out = expr->is_float ? make_double(std::strtod(text.c_str(), nullptr))
+                                 : make_int(std::strtoll(text.c_str(), nullptr, 10));
+            return true;
+        }
+        case ExprKind::String:
+            out = make_string(unescape_string(expr->text));
+            return true;
+        case ExprKind::Bool:
+            out = make_bool(expr->bool_value);
+            return true;
+        case ExprKind::None:
+            out = Value();
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Folds constant subexpressions (literal arithmetic and comparisons, BIFMath
+// calls, int()/float()) and propagates constants assigned to variables
+// through straight-line code. `if` arms and `while` loops whose condition is
+// known are dropped or spliced into the enclosing block. Runs on the parsed
+// tree, so the C++ emitter and --interp see the same folded program;
+// anything that would fail at run time is left alone.
+class ConstantFolder {
+public:
+    explicit ConstantFolder(Arena& arena) : arena_(arena) {}
+
+    void run(Program& program);
+
+private:
+    using Constants = std::unordered_map<std::string_view, Value>;
+
+    Block fold_block(const Block& block, Constants& known);
+    void fold_stmt(Stmt* stmt, Constants& known, Block& out);
+    Expr* fold(Expr* expr, const Constants& known);
+    Expr* fold_call(Expr* expr);
+    bool constant(const Expr* expr, Value& out) const;
+    Expr* literal(const Value& value);
+    Expr* number(std::string_view text, bool is_float, bool negative);
+    std::string_view store(const std::string& text);
+
+    Arena& arena_;
+};
+
+void append_block(Block& out, const Block& block) {
+    for (Stmt* stmt = block.first; stmt;) {
+        Stmt* next = stmt->next;
+        stmt->next = nullptr;
+        out.append(stmt);
+        stmt = next;
+    }
+}
+
+void collect_assigned(const Block& block, std::vector<std::string_view>& names) {
+    for (const Stmt* stmt = block.first; stmt; stmt = stmt->next) {
+        if (stmt->kind == StmtKind::Assign || stmt->kind == StmtKind::For) {
+            names.push_back(stmt->name);
+        }
+        collect_assigned(stmt->body, names);
+        collect_assigned(stmt->orelse, names);
+    }
+}
+
+bool same_constant(const Value& lhs, const Value& rhs) {
+    if (lhs.type != rhs.type) {
+        return false;
+    }
+    switch (lhs.type) {
+        case ValueType::Bool:
+        case ValueType::Int:
+            return lhs.i == rhs.i;
+        case ValueType::Double:
+            return lhs.d == rhs.d;
+        case ValueType::String:
+            return lhs.s == rhs.s;
+        case ValueType::None:
+            return true;
+        case ValueType::List:
+            return false;
+    }
+    return false;
+}
+
+void ConstantFolder::run(Program& program) {
+    Constants known;
+    program.body = fold_block(program.body, known);
+}
+
+Block ConstantFolder::fold_block(const Block& block, Constants& known) {
+    Block out;
+    for (Stmt* stmt = block.first; stmt;) {
+        Stmt* next = stmt->next;
+        stmt->next = nullptr;
+        fold_stmt(stmt, known, out);
+        stmt = next;
+    }
+    return out;
+}
+
+void ConstantFolder::fold_stmt(Stmt* stmt, Constants& known, Block& out) {
+    switch (stmt->kind) {
+        case StmtKind::Print:
+            for (size_t i = 0; i < stmt->args.size; ++i) {
+                stmt->args.items[i] = fold(stmt->args.items[i], known);
+            }
+            out.append(stmt);
+            return;
+        case StmtKind::Expr:
+            stmt->expr = fold(stmt->expr, known);
+            out.append(stmt);
+            return;
+        case StmtKind::Assign: {
+            stmt->expr = fold(stmt->expr, known);
+            Value value;
+            if (constant(stmt->expr, value)) {
+                known[stmt->name] = std::move(value);
+            } else {
+                known.erase(stmt->name);
+            }
+            out.append(stmt);
+            return;
+        }
+        case StmtKind::If: {
+            stmt->expr = fold(stmt->expr, known);
+            Value condition;
+            if (constant(stmt->expr, condition)) {
+                Block taken = fold_block(truthy(condition) ? stmt->body : stmt->orelse, known);
+                append_block(out, taken);
+                return;
+            }
+            Constants body_known = known;
+            stmt->body = fold_block(stmt->body, body_known);
+            stmt->orelse = fold_block(stmt->orelse, known);
+            for (auto it = known.begin(); it != known.end();) {
+                auto other = body_known.find(it->first);
+                if (other == body_known.end() || !same_constant(it->second, other->second)) {
+                    it = known.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            out.append(stmt);
+            return;
+        }
+        case StmtKind::While:
+        case StmtKind::For: {
+            if (stmt->kind == StmtKind::For) {
+                for (size_t i = 0; i < stmt->args.size; ++i) {
+                    stmt->args.items[i] = fold(stmt->args.items[i], known);
+                }
+            }
+            // Anything assigned in the loop may differ on every iteration.
+            std::vector<std::string_view> assigned;
+            if (stmt->kind == StmtKind::For) {
+                assigned.push_back(stmt->name);
+            }
+            collect_assigned(stmt->body, assigned);
+            for (std::string_view name : assigned) {
+                known.erase(name);
+            }
+            if (stmt->kind == StmtKind::While) {
+                stmt->expr = fold(stmt->expr, known);
+                Value condition;
+                if (constant(stmt->expr, condition) && !truthy(condition)) {
+                    return;
+                }
+            }
+            Constants body_known = known;
+            stmt->body = fold_block(stmt->body, body_known);
+            out.append(stmt);
+            return;
+        }
+    }
+}
+
+Expr* ConstantFolder::fold(Expr* expr, const Constants& known) {
+    switch (expr->kind) {
+        case ExprKind::Name: {
+            if (!expr->module.empty()) {
+                return expr;
+            }
+            auto it = known.find(expr->text);
+            if (it == known.end()) {
+                return expr;
+            }
+            Expr* value = literal(it->second);
+            return value ? value : expr;
+        }
+        case ExprKind::Unary: {
+            if (expr->op == Op::Neg && expr->lhs->kind == ExprKind::Number) {
+                return expr;
+            }
+            expr->lhs = fold(expr->lhs, known);
+            Value operand;
+            if (!constant(expr->lhs, operand)) {
+                return expr;
+            }
+            Value result;
+            if (expr->op == Op::Not) {
+                result = make_bool(!truthy(operand));
+            } else if (operand.type == ValueType::Double) {
+                result = make_double(expr->op == Op::Neg ? -operand.d : operand.d);
+            } else if (is_number(operand) && operand.i != INT64_MIN) {
+                result = make_int(expr->op == Op::Neg ? -operand.i : operand.i);
+            } else {
+                return expr;
+            }
+            Expr* folded = literal(result);
+            return folded ? folded : expr;
+        }
+        case ExprKind::Binary: {
+            expr->lhs = fold(expr->lhs, known);
+            expr->rhs = fold(expr->rhs, known);
+            Value lhs;
+            Value rhs;
+            bool lhs_known = constant(expr->lhs, lhs);
+            bool rhs_known = constant(expr->rhs, rhs);
+            Value result;
+            if (expr->op == Op::And || expr->op == Op::Or) {
+                // Both forms evaluate to a bool; a left side that decides the
+                // result also means the right side is never evaluated.
+                bool decides = expr->op == Op::Or;
+                if (lhs_known && truthy(lhs) == decides) {
+                    result = make_bool(decides);
+                } else if (lhs_known && rhs_known) {
+                    result = make_bool(truthy(rhs));
+                } else {
+                    return expr;
+                }
+            } else if (!lhs_known || !rhs_known) {
+                return expr;
+            } else {
+                try {
+                    if (expr->op >= Op::Eq && expr->op <= Op::Ge) {
+                        result = make_bool(compare(expr->op, lhs, rhs));
+                    } else {
+                        bool integral = lhs.type != ValueType::Double && rhs.type != ValueType::Double &&
+                                        (expr->op == Op::Add || expr->op == Op::Sub || expr->op == Op::Mul);
+                        if (integral && is_number(lhs) && is_number(rhs)) {
+                            // Leave anything near int64_t overflow to run time.
+                            double wide = expr->op == Op::Add   ? as_double(lhs) + as_double(rhs)
+                                          : expr->op == Op::Sub ? as_double(lhs) - as_double(rhs)
+                                                                : as_double(lhs) * as_double(rhs);
+                            if (std::fabs(wide) >= 4.0e18) {
+                                return expr;
+                            }
+                        }
+                        arithmetic(expr->op, lhs, rhs, result);
+                    }
+                } catch (const RuntimeError&) {
+                    return expr;
+                }
+            }
+            Expr* folded = literal(result);
+            return folded ? folded : expr;
+        }
+        case ExprKind::Call:
+            for (size_t i = 0; i < expr->args.size; ++i) {
+                expr->args.items[i] = fold(expr->args.items[i], known);
+            }
+            return fold_call(expr);
+        default:
+            return expr;
+    }
+}
+
+Expr* ConstantFolder::fold_call(Expr* expr) {
+    const Expr* callee = expr->lhs;
+    if (callee->kind != ExprKind::Name) {
+        return expr;
+    }
+    bool pure = callee->module == "BIFMath" ||
+                (callee->module.empty() && (callee->text == "int" || callee->text == "float"));
+    if (!pure || expr->args.size == 0) {
+        return expr;
+    }
+    Value args[2];
+    if (expr->args.size > 2) {
+        return expr;
+    }
+    for (size_t i = 0; i < expr->args.size; ++i) {
+        if (!constant(expr->args.items[i], args[i])) {
+            return expr;
+        }
+    }
+    for (const NativeFunction& fn : native_functions()) {
+        if (fn.module != callee->module || fn.name != callee->text || fn.arity != expr->args.size) {
+            continue;
+        }
+        Value result;
+        try {
+            call_native(fn, args, result);
+        } catch (const RuntimeError&) {
+            return expr;
+        }
+        Expr* folded = literal(result);
+        return folded ? folded : expr;
+    }
+    return expr;
+}
+
+// Literals, including a negated number literal.
+bool ConstantFolder::constant(const Expr* expr, Value& out) const {
+    if (expr->kind == ExprKind::Unary && expr->op == Op::Neg && expr->lhs->kind == ExprKind::Number) {
+        if (!literal_value(expr->lhs, out)) {
+            return false;
+        }
+        if (out.type == ValueType::Double) {
+            out.d = -out.d;
+        } else {
+            out.i = -out.i;
+        }
+        return true;
+    }
+    return literal_value(expr, out);
+}
+
+// Source form of a folded value, or null when it has none (inf, nan, lists).
+Expr* ConstantFolder::literal(const Value& value) {
+    switch (value.type) {
+        case ValueType::Bool: {
+            Expr* expr = arena_.make<Expr>();
+            expr->kind = ExprKind::Bool;
+            expr->bool_value = value.i != 0;
+            return expr;
+        }
+        case ValueType::None: {
+            Expr* expr = arena_.make<Expr>();
+            expr->kind = ExprKind::None;
+            return expr;
+        }
+        case ValueType::Int:
+            if (value.i == INT64_MIN) {
+                return nullptr;
+            }
+            return number(store(std::to_string(value.i < 0 ? -value.i : value.i)), false, value.i < 0);
+        case ValueType::Double: {
+            if (!std::isfinite(value.d)) {
+                return nullptr;
+            }
+            char text[32];
+            char* end = format_double(text, std::fabs(value.d));
+            return number(store(std::string(text, end)), true, std::signbit(value.d));
+        }
+        case ValueType::String: {
+            std::string text = "\"";
+            for (char ch : value.s) {
+                switch (ch) {
+                    case '\0':
+                        return nullptr;
+                    case '\n':
+                        text += "\\n";
+                        break;
+                    case '\r':
+                        text += "\\r";
+                        break;
+                    case '\t':
+                        text += "\\t";
+                        break;
+                    case '\\':
+                    case '"':
+                        text.push_back('\\');
+                        text.push_back(ch);
+                        break;
+                    default:
+                        text.push_back(ch);
+                        break;
+                }
+            }
+            text.push_back('"');
+            Expr* expr = arena_.make<Expr>();
+            expr->kind = ExprKind::String;
+            expr->text = store(text);
+            return expr;
+        }
+        case ValueType::List:
+            return nullptr;
+    }
+    return nullptr;
+}
+
+Expr* ConstantFolder::number(std::string_view text, bool is_float, bool negative) {
+    Expr* expr = arena_.make<Expr>();
+    expr->kind = ExprKind::Number;
+    expr->text = text;
+    expr->is_float = is_float;
+    if (!negative) {
+        return expr;
+    }
+    Expr* negated = arena_.make<Expr>();
+    negated->kind = ExprKind::Unary;
+    negated->op = Op::Neg;
+    negated->lhs = expr;
+    return negated;
+}
+
+std::string_view ConstantFolder::store(const std::string& text) {
+    char* data = arena_.make_array<char>(text.size());
+    std::memcpy(data, text.data(), text.size());
+    return std::string_view(data, text.size());
+}
+
+// `track_lines` instruments every statement with bif_line() (--profile,
+// --mem-stats); `split` allows chunked output for large programs.
+TranspileResult transpile_bif(const std::vector<std::string_view>& lines, bool track_lines = false, bool split = false) {
+    Arena arena;
+    Parser parser(arena);
+    TraceScope parse_trace("parse");
+    Program program = parser.parse_program(lines);
+    parse_trace.end();
+    {
+        TraceScope trace("fold constants");
+        ConstantFolder(arena).run(program);
+    }
+    {
+        TraceScope trace("dead stores");
+        remove_dead_stores(program);
+    }
+    TraceScope trace("emit");
+    CppEmitter emitter;
+    return emitter.emit_program(program, track_lines ? &lines : nullptr, split);
+}
+
+// Register machine instructions. Operands are register numbers unless noted:
+//   LoadConst a <- constants[b]          Move a <- b
+//   Add..Ge   a <- b (op) c              Not/Neg/ToBool a <- (op) b
+//   Jump      to a                       JumpIfFalse/JumpIfTrue on a, to b
+//   Print     a, then ' ' (b == 0) or newline (b == 1); PrintNewline
+//   Input     a <- input(b), prompt only when c == 1
+//   CallNative a <- native_functions()[b](c, c + 1, ...)
+//   MakeList  a <- [b .. b + c)          ToList a <- b as a list
+//   ForIter   a <- next item of list b (index in b + 1), or jump to c
+#define BIF_OPCODES(X) \
+    X(LoadConst)       \
+    X(Move)            \
+    X(Add)             \
+    X(Sub)             \
+    X(Mul)             \
+    X(Div)             \
+    X(FloorDiv)        \
+    X(Mod)             \
+    X(Pow)             \
+    X(Eq)              \
+    X(Ne)              \
+    X(Lt)              \
+    X(Le)              \
+    X(Gt)              \
+    X(Ge)              \
+    X(Not)             \
+    X(Neg)             \
+    X(ToBool)          \
+    X(Jump)            \
+    X(JumpIfFalse)     \
+    X(JumpIfTrue)      \
+    X(Print)           \
+    X(PrintNewline)    \
+    X(Input)           \
+    X(CallNative)      \
+    X(MakeList)        \
+    X(ToList)          \
+    X(ForIter)         \
+    X(Halt)
+
+enum class OpCode : uint8_t {
+#define BIF_OPCODE_ENUM(name) name,
+    BIF_OPCODES(BIF_OPCODE_ENUM)
+#undef BIF_OPCODE_ENUM
+};
+
+struct Instr {
+    OpCode op;
+    uint32_t a;
+    uint32_t b;
+    uint32_t c;
+};
+
+struct BytecodeProgram {
+    std::vector<Instr> code;
+    std::vector<int> lines;
+    std::vector<Value> constants;
+    uint32_t register_count = 0;
+};
+
+// Lowers the syntax tree to register bytecode. Variables own the low registers;
+// temporaries are stacked above them and released after each expression.
+class BytecodeCompiler {
+public:
+    BytecodeProgram compile(const Program& program);
+
+private:
+    void declare_block(const Block& block);
+    void compile_block(const Block& block);
+    void compile_stmt(const Stmt* stmt);
+    void compile_into(const Expr* expr, uint32_t dst);
+    void compile_call(const Expr* expr, uint32_t dst);
+    uint32_t compile_operand(const Expr* expr);
+    uint32_t add_constant(Value value);
+    size_t emit(OpCode op, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0);
+    uint32_t here() const;
+    uint32_t alloc_temp();
+    [[noreturn]] void fail(const std::string& message) const;
+
+    BytecodeProgram program_;
+    std::unordered_map<std::string_view, uint32_t> variables_;
+    std::unordered_set<std::string_view> assigned_;
+    uint32_t variable_count_ = 0;
+    uint32_t next_temp_ = 0;
+    int line_ = 0;
+};
+
+void BytecodeCompiler::fail(const std::string& message) const {
+    throw ParseError{line_error(line_, message)};
+}
+
+size_t BytecodeCompiler::emit(OpCode op, uint32_t a, uint32_t b, uint32_t c) {
+    program_.code.push_back(Instr{op, a, b, c});
+    program_.lines.push_back(line_);
+    return program_.code.size() - 1;
+}
+
+uint32_t BytecodeCompiler::here() const {
+    return static_cast<uint32_t>(program_.code.size());
+}
+
+uint32_t BytecodeCompiler::alloc_temp() {
+    uint32_t reg = next_temp_++;
+    program_.register_count = std::max(program_.register_count, next_temp_);
+    return reg;
+}
+
+uint32_t BytecodeCompiler::add_constant(Value value) {
+    program_.constants.push_back(std::move(value));
+    return static_cast<uint32_t>(program_.constants.size() - 1);
+}
+
+void BytecodeCompiler::declare_block(const Block& block) {
+    for (const Stmt* stmt = block.first; stmt; stmt = stmt->next) {
+        if (stmt->kind == StmtKind::Assign || stmt->kind == StmtKind::For) {
+            if (variables_.emplace(stmt->name, variable_count_).second) {
+                ++variable_count_;
+            }
+        }
+        declare_block(stmt->body);
+        declare_block(stmt->orelse);
+    }
+}
+
+uint32_t BytecodeCompiler::compile_operand(const Expr* expr) {
+    if (expr->kind == ExprKind::Name && expr->module.empty() && assigned_.count(expr->text)) {
+        return variables_.at(expr->text);
+    }
+    uint32_t reg = alloc_temp();
+    compile_into(expr, reg);
+    return reg;
+}
+
+void BytecodeCompiler::compile_into(const Expr* expr, uint32_t dst) {
+    uint32_t mark = next_temp_;
+    Value constant;
+    if (literal_value(expr, constant)) {
+        emit(OpCode::LoadConst, dst, add_constant(std::move(constant)));
+        return;
+    }
+
+    switch (expr->kind) {
+        case ExprKind::Name:
+            if (!expr->module.empty()) {
+                fail("'" + std::string(expr->module) + "." + std::string(expr->text) + "' can only be called.");
+            }
+            if (!assigned_.count(expr->text)) {
+                fail("Name '" + std::string(expr->text) + "' is not defined.");
+            }
+            if (variables_.at(expr->text) != dst) {
+                emit(OpCode::Move, dst, variables_.at(expr->text));
+            }
+            break;
+        case ExprKind::Unary:
+            if (expr->op == Op::Pos) {
+                compile_into(expr->lhs, dst);
+            } else {
+                emit(expr->op == Op::Not ? OpCode::Not : OpCode::Neg, dst, compile_operand(expr->lhs));
+            }
+            break;
+        case ExprKind::Binary: {
+            if (expr->op == Op::And || expr->op == Op::Or) {
+                // The left operand is written before the right one is read, so
+                // never short-circuit straight into a variable.
+                uint32_t reg = (dst < variable_count_) ? alloc_temp() : dst;
+                compile_into(expr->lhs, reg);
+                emit(OpCode::ToBool, reg, reg);
+                size_t skip = emit(expr->op == Op::And ? OpCode::JumpIfFalse : OpCode::JumpIfTrue, reg);
+                compile_into(expr->rhs, reg);
+                emit(OpCode::ToBool, reg, reg);
+                program_.code[skip].b = here();
+                if (reg != dst) {
+                    emit(OpCode::Move, dst, reg);
+                }
+                break;
+            }
+            uint32_t lhs = compile_operand(expr->lhs);
+            uint32_t rhs = compile_operand(expr->rhs);
+            static const OpCode opcodes[] = {
+                OpCode::Halt, OpCode::Halt, OpCode::Halt, OpCode::Eq,  OpCode::Ne,       OpCode::Lt,
+                OpCode::Le,   OpCode::Gt,   OpCode::Ge,   OpCode::Add, OpCode::Sub,      OpCode::Mul,
+                OpCode::Div,  OpCode::FloorDiv, OpCode::Mod, OpCode::Pow,
+            };
+            emit(opcodes[static_cast<size_t>(expr->op)], dst, lhs, rhs);
+            break;
+        }
+        case ExprKind::Call:
+            compile_call(expr, dst);
+            break;
+        case ExprKind::Attribute:
+            fail("Attribute access is not supported by --interp.");
+        default:
+            break;
+    }
+    next_temp_ = mark;
+}
+
+void BytecodeCompiler::compile_call(const Expr* expr, uint32_t dst) {
+    const Expr* callee = expr->lhs;
+    if (callee->kind != ExprKind::Name) {
+        fail("Method calls are not supported by --interp.");
+    }
+
+    if (callee->module.empty() && callee->text == "input") {
+        if (expr->args.size > 1) {
+            fail("input() takes at most one argument.");
+        }
+        uint32_t prompt = expr->args.size ? compile_operand(expr->args.items[0]) : 0;
+        emit(OpCode::Input, dst, prompt, expr->args.size ? 1 : 0);
+        return;
+    }
+
+    const std::vector<NativeFunction>& natives = native_functions();
+    for (size_t index = 0; index < natives.size(); ++index) {
+        const NativeFunction& fn = natives[index];
+        if (fn.module != callee->module || fn.name != callee->text || fn.arity != expr->args.size) {
+            continue;
+        }
+        uint32_t base = next_temp_;
+        for (const Expr* arg : expr->args) {
+            compile_into(arg, alloc_temp());
+        }
+        emit(OpCode::CallNative, dst, static_cast<uint32_t>(index), base);
+        return;
+    }
+
+    std::string name = callee->module.empty() ? std::string(callee->text)
+                                              : std::string(callee->module) + "." + std::string(callee->text);
+    fail("'" + name + "' with " + std::to_string(expr->args.size) + " argument(s) is not supported by --interp.");
+}
+
+void BytecodeCompiler::compile_block(const Block& block) {
+    for (const Stmt* stmt = block.first; stmt; stmt = stmt->next) {
+        compile_stmt(stmt);
+    }
+}
+
+void BytecodeCompiler::compile_stmt(const Stmt* stmt) {
+    line_ = stmt->line;
+    uint32_t mark = next_temp_;
+    switch (stmt->kind) {
+        case StmtKind::Print:
+            if (stmt->args.size == 0) {
+                emit(OpCode::PrintNewline);
+            }
+            for (size_t i = 0; i < stmt->args.size; ++i) {
+                emit(OpCode::Print, compile_operand(stmt->args.items[i]), i + 1 == stmt->args.size ? 1 : 0);
+                next_temp_ = mark;
+            }
+            break;
+        case StmtKind::Assign:
+            compile_into(stmt->expr, variables_.at(stmt->name));
+            assigned_.insert(stmt->name);
+            break;
+        case StmtKind::Expr:
+            compile_into(stmt->expr, alloc_temp());
+            break;
+        case StmtKind::If: {
+            size_t skip = emit(OpCode::JumpIfFalse, compile_operand(stmt->expr));
+            next_temp_ = mark;
+            compile_block(stmt->body);
+            if (stmt->has_else) {
+                size_t done = emit(OpCode::Jump);
+                program_.code[skip].b = here();
+                compile_block(stmt->orelse);
+                program_.code[done].a = here();
+            } else {
+                program_.code[skip].b = here();
+            }
+            break;
+        }
+        case StmtKind::While: {
+            uint32_t top = here();
+            size_t exit = emit(OpCode::JumpIfFalse, compile_operand(stmt->expr));
+            next_temp_ = mark;
+            compile_block(stmt->body);
+            line_ = stmt->line;
+            emit(OpCode::Jump, top);
+            program_.code[exit].b = here();
+            break;
+        }
+        case StmtKind::For: {
+            uint32_t list = alloc_temp();
+            uint32_t index = alloc_temp();
+            ValueList items;
+            Value item;
+            bool all_constant = true;
+            for (const Expr* expr : stmt->args) {
+                if (!literal_value(expr, item)) {
+                    all_constant = false;
+                    break;
+                }
+                items.push_back(item);
+            }
+            if (all_constant) {
+                promote_loop_items(items);
+                emit(OpCode::LoadConst, list, add_constant(make_list(std::move(items))));
+            } else if (stmt->args.size == 1) {
+                compile_into(stmt->args.items[0], list);
+                emit(OpCode::ToList, list, list);
+            } else {
+                uint32_t base = next_temp_;
+                for (const Expr* expr : stmt->args) {
+                    compile_into(expr, alloc_temp());
+                }
+                emit(OpCode::MakeList, list, base, static_cast<uint32_t>(stmt->args.size));
+                next_temp_ = index + 1;
+            }
+            emit(OpCode::LoadConst, index, add_constant(make_int(0)));
+
+            uint32_t variable = variables_.at(stmt->name);
+            assigned_.insert(stmt->name);
+            uint32_t top = here();
+            size_t exit = emit(OpCode::ForIter, variable, list);
+            compile_block(stmt->body);
+            line_ = stmt->line;
+            emit(OpCode::Jump, top);
+            program_.code[exit].c = here();
+            break;
+        }
+    }
+    next_temp_ = mark;
+}
+
+BytecodeProgram BytecodeCompiler::compile(const Program& program) {
+    program_ = BytecodeProgram();
+    variables_.clear();
+    assigned_.clear();
+    variable_count_ = 0;
+    declare_block(program.body);
+    next_temp_ = variable_count_;
+    program_.register_count = variable_count_;
+    compile_block(program.body);
+    emit(OpCode::Halt);
+    return std::move(program_);
+}
+
+// Runs `program` to completion. GCC and Clang dispatch through a label table
+// (computed goto); other compilers, or -DBIFC_VM_SWITCH, use a switch loop.
+void run_bytecode(const BytecodeProgram& program, bool flush_lines) {
+    std::vector<Value> regs(program.register_count);
+    const Instr* code = program.code.data();
+    const Instr* ip = code;
+    Value* r = regs.data();
+
+#if defined(__GNUC__) && !defined(BIFC_VM_SWITCH)
+    static void* const labels[] = {
+#define BIF_OPCODE_LABEL(name) &&op_##name,
+        BIF_OPCODES(BIF_OPCODE_LABEL)
+#undef BIF_OPCODE_LABEL
+    };
+#define VM_CASE(name) op_##name:
+#define VM_DISPATCH() goto* labels[static_cast<size_t>(ip->op)]
+#define VM_NEXT() \
+    do { \
+        ++ip; \
+        VM_DISPATCH(); \
+    } while (0)
+#define VM_JUMP(target) \
+    do { \
+        ip = code + (target); \
+        VM_DISPATCH(); \
+    } while (0)
+#define VM_LOOP_BEGIN() VM_DISPATCH();
+#define VM_LOOP_END()
+#else
+#define VM_CASE(name) case OpCode::name:
+#define VM_NEXT() \
+    ++ip; \
+    continue
+#define VM_JUMP(target) \
+    ip = code + (target); \
+    continue
+#define VM_LOOP_BEGIN() \
+    for (;;) { \
+        switch (ip->op) {
+#define VM_LOOP_END() \
+    } \
+    }
+#endif
+
+#define VM_ARITH(name, int_result, double_result) \
+    VM_CASE(name) { \
+        const Value& lhs = r[ip->b]; \
+        const Value& rhs = r[ip->c]; \
+        if (lhs.type == ValueType::Int && rhs.type == ValueType::Int) { \
+            set_int(r[ip->a], int_result); \
+        } else if (lhs.type == ValueType::Double && rhs.type == ValueType::Double) { \
+            set_double(r[ip->a], double_result); \
+        } else { \
+            arithmetic(Op::name, lhs, rhs, r[ip->a]); \
+        } \
+        VM_NEXT(); \
+    }
+#define VM_COMPARE(name, symbol) \
+    VM_CASE(name) { \
+        const Value& lhs = r[ip->b]; \
+        const Value& rhs = r[ip->c]; \
+        if (lhs.type == ValueType::Int && rhs.type == ValueType::Int) { \
+            set_bool(r[ip->a], lhs.i symbol rhs.i); \
+        } else if (lhs.type == ValueType::Double && rhs.type == ValueType::Double) { \
+            set_bool(r[ip->a], lhs.d symbol rhs.d); \
+        } else { \
+            set_bool(r[ip->a], compare(Op::name, lhs, rhs)); \
+        } \
+        VM_NEXT(); \
+    }
+
+    try {
+    VM_LOOP_BEGIN()
+    VM_CASE(LoadConst) {
+        copy_value(r[ip->a], program.constants[ip->b]);
+        VM_NEXT();
+    }
+    VM_CASE(Move) {
+        copy_value(r[ip->a], r[ip->b]);
+        VM_NEXT();
+    }
+    VM_ARITH(Add, lhs.i + rhs.i, lhs.d + rhs.d)
+    VM_ARITH(Sub, lhs.i - rhs.i, lhs.d - rhs.d)
+    VM_ARITH(Mul, lhs.i * rhs.i, lhs.d * rhs.d)
+    VM_CASE(Div) {
+        arithmetic(Op::Div, r[ip->b], r[ip->c], r[ip->a]);
+        VM_NEXT();
+    }
+    VM_CASE(FloorDiv) {
+        arithmetic(Op::FloorDiv, r[ip->b], r[ip->c], r[ip->a]);
+        VM_NEXT();
+    }
+    VM_CASE(Mod) {
+        arithmetic(Op::Mod, r[ip->b], r[ip->c], r[ip->a]);
+        VM_NEXT();
+    }
+    VM_CASE(Pow) {
+        arithmetic(Op::Pow, r[ip->b], r[ip->c], r[ip->a]);
+        VM_NEXT();
+    }
+    VM_COMPARE(Eq, ==)
+    VM_COMPARE(Ne, !=)
+    VM_COMPARE(Lt, <)
+    VM_COMPARE(Le, <=)
+    VM_COMPARE(Gt, >)
+    VM_COMPARE(Ge, >=)
+    VM_CASE(Not) {
+        set_bool(r[ip->a], !truthy(r[ip->b]));
+        VM_NEXT();
+    }
+    VM_CASE(Neg) {
+        const Value& operand = r[ip->b];
+        if (operand.type == ValueType::Double) {
+            set_double(r[ip->a], -operand.d);
+        } else if (is_number(operand)) {
+            set_int(r[ip->a], -operand.i);
+        } else {
+            throw RuntimeError{std::string("Bad operand type for unary -: '") + type_name(operand) + "'."};
+        }
+        VM_NEXT();
+    }
+    VM_CASE(ToBool) {
+        set_bool(r[ip->a], truthy(r[ip->b]));
+        VM_NEXT();
+    }
+    VM_CASE(Jump) {
+        VM_JUMP(ip->a);
+    }
+    VM_CASE(JumpIfFalse) {
+        const Value& cond = r[ip->a];
+        if (cond.type == ValueType::Bool ? cond.i == 0 : !truthy(cond)) {
+            VM_JUMP(ip->b);
+        }
+        VM_NEXT();
+    }
+    VM_CASE(JumpIfTrue) {
+        const Value& cond = r[ip->a];
+        if (cond.type == ValueType::Bool ? cond.i != 0 : truthy(cond)) {
+            VM_JUMP(ip->b);
+        }
+        VM_NEXT();
+    }
+    VM_CASE(Print) {
+        write_value(std::cout, r[ip->a]);
+        std::cout.put(ip->b ? '\n' : ' ');
+        if (ip->b && flush_lines) {
+            std::cout.flush();
+        }
+        VM_NEXT();
+    }
+    VM_CASE(PrintNewline) {
+        std::cout.put('\n');
+        if (flush_lines) {
+            std::cout.flush();
+        }
+        VM_NEXT();
+    }
+    VM_CASE(Input) {
+        if (ip->c) {
+            write_value(std::cout, r[ip->b]);
+        }
+        std::cout.flush();
+        std::string line;
+        std::getline(std::cin, line);
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        r[ip->a].type = ValueType::String;
+        r[ip->a].s = std::move(line);
+        VM_NEXT();
+    }
+    VM_CASE(CallNative) {
+        call_native(native_functions()[ip->b], r + ip->c, r[ip->a]);
+        VM_NEXT();
+    }
+    VM_CASE(MakeList) {
+        ValueList items;
+        items.reserve(ip->c);
+        for (uint32_t i = 0; i < ip->c; ++i) {
+            items.push_back(r[ip->b + i]);
+        }
+        promote_loop_items(items);
+        r[ip->a] = make_list(std::move(items));
+        VM_NEXT();
+    }
+    VM_CASE(ToList) {
+        if (r[ip->b].type != ValueType::List) {
+            r[ip->a] = make_list(ValueList{r[ip->b]});
+        } else if (ip->a != ip->b) {
+            copy_value(r[ip->a], r[ip->b]);
+        }
+        VM_NEXT();
+    }
+    VM_CASE(ForIter) {
+        const ValueList& items = *r[ip->b].list;
+        Value& index = r[ip->b + 1];
+        if (static_cast<size_t>(index.i) >= items.size()) {
+            VM_JUMP(ip->c);
+        }
+        copy_value(r[ip->a], items[static_cast<size_t>(index.i++)]);
+        VM_NEXT();
+    }
+    VM_CASE(Halt) {
+        return;
+    }
+    VM_LOOP_END()
+    } catch (const RuntimeError& err) {
+        throw RuntimeError{line_error(program.lines[static_cast<size_t>(ip - code)], err.message)};
+    }
+#undef VM_COMPARE
+#undef VM_LOOP_END
+#undef VM_LOOP_BEGIN
+#undef VM_ARITH
+#undef VM_JUMP
+#undef VM_NEXT
+#undef VM_DISPATCH
+#undef VM_CASE
+}
+
+// Output goes through std::cout's own buffer (detached from stdio) with the
+// same flush points as compiled programs.
+int interpret_bif(const std::vector<std::string_view>& lines, bool flush_lines) {
+    Arena arena;
+    Parser parser(arena);
+    try {
+        TraceScope parse_trace("parse");
+        Program parsed = parser.parse_program(lines);
+        parse_trace.end();
+        {
+            TraceScope trace("fold constants");
+            ConstantFolder(arena).run(parsed);
+        }
+        {
+            TraceScope trace("dead stores");
+            remove_dead_stores(parsed);
+        }
+        TraceScope compile_trace("compile bytecode");
+        BytecodeCompiler compiler;
+        BytecodeProgram program = compiler.compile(parsed);
+        compile_trace.end();
+        TraceScope trace("run bytecode");
+        std::ios::sync_with_stdio(false);
+        run_bytecode(program, flush_lines);
+        std::cout.flush();
+    } catch (const ParseError& err) {
+        std::cerr << err.message << std::endl;
+        return 2;
+    } catch (const RuntimeError& err) {
+        std::cout.flush();
+        std::cerr << err.message << std::endl;
+        return 4;
+    }
+    return 0;
+}
+
+std::string read_file_text(const fs::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return "";
+    }
+    std::ostringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+const std::unordered_map<std::string, std::string>& library_headers() {
+    static const std::unordered_map<std::string, std::string> headers = {
+        {"BIFMath", "libs/BIFMath/BIFMath.h"},
+        {"BIFitertools", "libs/BIFitertools/BIFitertools.h"},
+        {"BIFtkinter", "libs/BIFtkinter/BIFtkinter.h"},
+    };
+    return headers;
+}
+
+// Library modules with compiled sources on this platform; these make up libbif.a.
+const std::unordered_map<std::string, std::string>& library_sources() {
+    static const std::unordered_map<std::string, std::string> sources = {
+        {"BIFMath", "libs/BIFMath/BIFMath.cpp"},
+        {"BIFitertools", "libs/BIFitertools/BIFitertools.cpp"},
+#ifdef _WIN32
+        {"BIFtkinter", "libs/BIFtkinter/BIFtkinter.cpp"},
+#endif
+    };
+    return sources;
+}
+
+// Standard headers of every generated program; the precompiled prelude
+// includes the same set.
+constexpr std::string_view kCppIncludes =
+    "#include <algorithm>\n"
+    "#include <charconv>\n"
+    "#include <cstdint>\n"
+    "#include <cstdio>\n"
+    "#include <cstdlib>\n"
+    "#include <cstring>\n"
+    "#include <iostream>\n"
+    "#include <sstream>\n"
+    "#include <string>\n"
+    "#include <string_view>\n"
+    "#include <type_traits>\n"
+    "#include <utility>\n"
+    "#include <vector>\n";
+
+// I/O runtime of generated programs. print() appends to a 64 KB buffer
+// that is written out when full, before the program waits for input and at
+// exit; with --unbuffered also after every line. input() takes lines from a
+// block reader over fd 0, and int(input()) / float(input()) parse them in
+// place with std::from_chars.
+constexpr std::string_view kCppRuntime = R"(
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+struct BifOutput {
+    explicit BifOutput(bool flush_lines) : flush_lines(flush_lines) {
+        std::setvbuf(stdout, nullptr, _IONBF, 0);
+    }
+
+    ~BifOutput() {
+        flush();
+    }
+
+    void flush() {
+        if (size > 0) {
+            std::fwrite(data, 1, size, stdout);
+            size = 0;
+        }
+    }
+
+    void write(const char* text, size_t count) {
+        if (count > sizeof(data) - size) {
+            flush();
+            if (count > sizeof(data)) {
+                std::fwrite(text, 1, count, stdout);
+                return;
+            }
+        }
+        std::memcpy(data + size, text, count);
+        size += count;
+    }
+
+    void put(char ch) {
+        if (size == sizeof(data)) {
+            flush();
+        }
+        data[size++] = ch;
+    }
+
+    void end_line() {
+        put('\n');
+        if (flush_lines) {
+            flush();
+        }
+    }
+
+    bool flush_lines;
+    size_t size = 0;
+    char data[1 << 16];
+};
+
+extern BifOutput bif_out;
+
+// Python's repr(float): shortest round-trip digits, positional for exponents
+// -4..15 with at least one fractional digit, scientific (1e+16) otherwise.
+inline char* bif_format_double(char* text, double value) {
+    if (value != value) {
+        std::memcpy(text, "nan", 3);
+        return text + 3;
+    }
+    char* end = std::to_chars(text, text + 32, value, std::chars_format::scientific).ptr;
+    const char* mark = std::find(text, end, 'e');
+    if (mark == end) {
+        return end;
+    }
+    int exponent = 0;
+    for (const char* digit = mark + 2; digit < end; ++digit) {
+        exponent = exponent * 10 + (*digit - '0');
+    }
+    if (mark[1] == '-') {
+        exponent = -exponent;
+    }
+    if (exponent < -4 || exponent >= 16) {
+        return end;
+    }
+    end = std::to_chars(text, text + 32, value, std::chars_format::fixed).ptr;
+    if (std::find(text, end, '.') == end) {
+        std::memcpy(end, ".0", 2);
+        end += 2;
+    }
+    return end;
+}
+
+template <typename T>
+void bif_write(const T& value) {
+    if constexpr (std::is_same_v<T, bool>) {
+        bif_out.put(value ? '1' : '0');
+    } else if constexpr (std::is_integral_v<T>) {
+        char text[24];
+        auto end = std::to_chars(text, text + sizeof(text), value).ptr;
+        bif_out.write(text, static_cast<size_t>(end - text));
+    } else if constexpr (std::is_floating_point_v<T>) {
+        char text[32];
+        char* end = bif_format_double(text, static_cast<double>(value));
+        bif_out.write(text, static_cast<size_t>(end - text));
+    } else if constexpr (std::is_null_pointer_v<T>) {
+        bif_out.write("None", 4);
+    } else if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+        std::string_view text = value;
+        bif_out.write(text.data(), text.size());
+    } else {
+        std::ostringstream text;
+        text << value;
+        bif_write(text.str());
+    }
+}
+
+template <typename... Args>
+void bif_print(const Args&... args) {
+    bool first = true;
+    ((first ? void() : bif_out.put(' '), first = false, bif_write(args)), ...);
+    bif_out.end_line();
+}
+
+struct BifInput {
+    // Next line without its line break; the view stays valid until the next
+    // call. Returns false once stdin is exhausted.
+    bool next_line(std::string_view& line) {
+        for (;;) {
+            const char* newline = static_cast<const char*>(std::memchr(data.data() + begin, '\n', end - begin));
+            if (newline || eof) {
+                if (begin == end) {
+                    return false;
+                }
+                size_t stop = newline ? static_cast<size_t>(newline - data.data()) : end;
+                line = std::string_view(data.data() + begin, stop - begin);
+                begin = newline ? stop + 1 : end;
+                if (!line.empty() && line.back() == '\r') {
+                    line.remove_suffix(1);
+                }
+                return true;
+            }
+            fill();
+        }
+    }
+
+    // input() semantics: an empty line at end of input.
+    std::string_view line() {
+        std::string_view text;
+        return next_line(text) ? text : std::string_view();
+    }
+
+    void fill() {
+        if (begin > 0) {
+            std::memmove(data.data(), data.data() + begin, end - begin);
+            end -= begin;
+            begin = 0;
+        }
+        if (end == data.size()) {
+            data.resize(data.size() * 2);
+        }
+        // Whoever is waiting on us should see everything printed so far.
+        bif_out.flush();
+#ifdef _WIN32
+        int count = _read(0, data.data() + end, static_cast<unsigned>(data.size() - end));
+#else
+        ssize_t count = read(0, data.data() + end, data.size() - end);
+#endif
+        if (count <= 0) {
+            eof = true;
+        } else {
+            end += static_cast<size_t>(count);
+        }
+    }
+
+    std::vector<char> data = std::vector<char>(1 << 16);
+    size_t begin = 0;
+    size_t end = 0;
+    bool eof = false;
+};
+
+inline BifInput bif_in;
+
+[[noreturn]] inline void bif_fail(const std::string& message) {
+    bif_out.flush();
+    std::fprintf(stderr, "%s\n", message.c_str());
+    std::exit(1);
+}
+
+inline std::string_view bif_strip(std::string_view text) {
+    const char* space = " \t\n\r\f\v";
+    size_t first = text.find_first_not_of(space);
+    if (first == std::string_view::npos) {
+        return std::string_view();
+    }
+    return text.substr(first, text.find_last_not_of(space) - first + 1);
+}
+
+// int(text) / float(text): surrounding whitespace and a leading '+' are
+// accepted like in Python; anything else left over is a ValueError.
+inline int64_t bif_parse_int(std::string_view text) {
+    std::string_view digits = bif_strip(text);
+    if (digits.size() > 1 && digits[0] == '+' && digits[1] != '-') {
+        digits.remove_prefix(1);
+    }
+    int64_t value = 0;
+    auto parsed = std::from_chars(digits.data(), digits.data() + digits.size(), value);
+    if (digits.empty() || parsed.ec != std::errc() || parsed.ptr != digits.data() + digits.size()) {
+        bif_fail("ValueError: invalid literal for int() with base 10: '" + std::string(text) + "'");
+    }
+    return value;
+}
+
+inline double bif_parse_float(std::string_view text) {
+    std::string_view digits = bif_strip(text);
+    if (digits.size() > 1 && digits[0] == '+' && digits[1] != '-') {
+        digits.remove_prefix(1);
+    }
+    double value = 0.0;
+    auto parsed = std::from_chars(digits.data(), digits.data() + digits.size(), value);
+    if (digits.empty() || parsed.ec != std::errc() || parsed.ptr != digits.data() + digits.size()) {
+        bif_fail("ValueError: could not convert string to float: '" + std::string(text) + "'");
+    }
+    return value;
+}
+
+template <typename T>
+int64_t bif_int(const T& value) {
+    if constexpr (std::is_arithmetic_v<T>) {
+        return static_cast<int64_t>(value);
+    } else {
+        return bif_parse_int(value);
+    }
+}
+
+template <typename T>
+double bif_float(const T& value) {
+    if constexpr (std::is_arithmetic_v<T>) {
+        return static_cast<double>(value);
+    } else {
+        return bif_parse_float(value);
+    }
+}
+
+// `//` on integers rounds toward negative infinity, as in Python.
+inline int64_t bif_floor_div(int64_t lhs, int64_t rhs) {
+    int64_t quotient = lhs / rhs;
+    return (lhs % rhs != 0 && (lhs < 0) != (rhs < 0)) ? quotient - 1 : quotient;
+}
+
+// `%` on integers takes the sign of the divisor, so that
+// a == (a // b) * b + a % b.
+inline int64_t bif_floor_mod(int64_t lhs, int64_t rhs) {
+    int64_t rest = lhs % rhs;
+    return (rest != 0 && (rest < 0) != (rhs < 0)) ? rest + rhs : rest;
+}
+
+// Integer `**` by squaring, wrapping on overflow; a negative exponent
+// (only known at run time) gives 1.
+inline int64_t bif_int_pow(int64_t base, int64_t exponent) {
+    uint64_t result = 1;
+    uint64_t factor = static_cast<uint64_t>(base);
+    for (; exponent > 0; exponent >>= 1) {
+        if (exponent & 1) {
+            result *= factor;
+        }
+        factor *= factor;
+    }
+    return static_cast<int64_t>(result);
+}
+
+inline std::string bif_input(std::string_view prompt) {
+    bif_write(prompt);
+    return std::string(bif_in.line());
+}
+
+inline int64_t bif_input_int(std::string_view prompt) {
+    bif_write(prompt);
+    return bif_parse_int(bif_in.line());
+}
+
+inline double bif_input_float(std::string_view prompt) {
+    bif_write(prompt);
+    return bif_parse_float(bif_in.line());
+}
+
+// `for line in input_lines():` walks the rest of stdin one line at a time,
+// reusing a single string for the current line.
+struct BifInputLines {
+    struct iterator {
+        const std::string& operator*() const {
+            return lines->current;
+        }
+
+        iterator& operator++() {
+            if (!lines->advance()) {
+                lines = nullptr;
+            }
+            return *this;
+        }
+
+        bool operator!=(const iterator& other) const {
+            return lines != other.lines;
+        }
+
+        BifInputLines* lines;
+    };
+
+    iterator begin() {
+        return iterator{advance() ? this : nullptr};
+    }
+
+    iterator end() {
+        return iterator{nullptr};
+    }
+
+    operator std::vector<std::string>() {
+        std::vector<std::string> all;
+        for (const std::string& line : *this) {
+            all.push_back(line);
+        }
+        return all;
+    }
+
+    bool advance() {
+        std::string_view line;
+        if (!bif_in.next_line(line)) {
+            return false;
+        }
+        current.assign(line.data(), line.size());
+        return true;
+    }
+
+    std::string current;
+};
+
+inline BifInputLines bif_input_lines() {
+    return BifInputLines();
+}
+
+)";
+
+// Shared by the --profile and --mem-stats runtimes: the instrumented lines
+// (bif_source_lines, terminated by line 0) and the JSON report plumbing.
+constexpr std::string_view kCppLineRuntime = R"(
+struct BifSourceLine {
+    int line;
+    const char* source;
+};
+
+inline std::FILE* bif_open_report(const char* variable) {
+    const char* path = std::getenv(variable);
+    return path && *path ? std::fopen(path, "wb") : nullptr;
+}
+
+inline void bif_json_string(std::FILE* json, const char* text) {
+    std::fputc('"', json);
+    for (const char* ch = text; *ch; ++ch) {
+        unsigned char byte = static_cast<unsigned char>(*ch);
+        if (*ch == '"' || *ch == '\\') {
+            std::fprintf(json, "\\%c", *ch);
+        } else if (byte < 0x20) {
+            std::fprintf(json, "\\u%04x", byte);
+        } else {
+            std::fputc(*ch, json);
+        }
+    }
+    std::fputc('"', json);
+}
+
+)";
+
+// --profile: enter(line) charges the ticks since the previous call to the
+// line that was running, so every line gets its self time. The report goes
+// to stderr at exit, and as JSON to the file named by $BIF_PROFILE.
+constexpr std::string_view kCppProfileRuntime = R"(
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+inline uint64_t bif_profile_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+struct BifProfile {
+    BifProfile() : hits(bif_max_line + 1), ticks(bif_max_line + 1) {
+        start_time = std::chrono::steady_clock::now();
+        start = last = bif_profile_ticks();
+    }
+
+    ~BifProfile() {
+        uint64_t now = bif_profile_ticks();
+        ticks[current] += now - last;
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        double per_tick = now > start ? seconds / static_cast<double>(now - start) : 0.0;
+        report(seconds, per_tick);
+    }
+
+    void enter(int line) {
+        uint64_t now = bif_profile_ticks();
+        ticks[current] += now - last;
+        last = now;
+        current = line;
+        ++hits[line];
+    }
+
+    void report(double seconds, double per_tick) {
+        bif_out.flush();
+        std::vector<const BifSourceLine*> order;
+        for (const BifSourceLine* entry = bif_source_lines; entry->line; ++entry) {
+            if (hits[entry->line] > 0) {
+                order.push_back(entry);
+            }
+        }
+        std::stable_sort(order.begin(), order.end(), [&](const BifSourceLine* a, const BifSourceLine* b) {
+            return ticks[a->line] > ticks[b->line];
+        });
+
+        std::fprintf(stderr, "\nbif profile: %.3f s\n%6s %12s %12s %7s  %s\n", seconds, "line", "count", "self ms",
+                     "self", "source");
+        for (const BifSourceLine* entry : order) {
+            double self = static_cast<double>(ticks[entry->line]) * per_tick;
+            std::fprintf(stderr, "%6d %12llu %12.3f %6.1f%%  %s\n", entry->line,
+                         static_cast<unsigned long long>(hits[entry->line]), self * 1000.0,
+                         seconds > 0.0 ? self * 100.0 / seconds : 0.0, entry->source);
+        }
+
+        std::FILE* json = bif_open_report("BIF_PROFILE");
+        if (!json) {
+            return;
+        }
+        std::fprintf(json, "{\"seconds\": %.9f, \"lines\": [", seconds);
+        for (size_t i = 0; i < order.size(); ++i) {
+            const BifSourceLine* entry = order[i];
+            std::fprintf(json, "%s\n  {\"line\": %d, \"count\": %llu, \"self_seconds\": %.9f, \"source\": ",
+                         i > 0 ? "," : "", entry->line, static_cast<unsigned long long>(hits[entry->line]),
+                         static_cast<double>(ticks[entry->line]) * per_tick);
+            bif_json_string(json, entry->source);
+            std::fputc('}', json);
+        }
+        std::fputs("\n]}\n", json);
+        std::fclose(json);
+    }
+
+    std::vector<uint64_t> hits;
+    std::vector<uint64_t> ticks;
+    std::chrono::steady_clock::time_point start_time;
+    uint64_t start = 0;
+    uint64_t last = 0;
+    int current = 0;
+};
+
+BifProfile bif_profile;
+
+)";
+
+// --mem-stats: replaces the global operator new/delete. Every block carries
+// a 16-byte header with its size and the line that allocated it, so frees
+// are charged back to that line. The counters are plain zero-initialized
+// arrays, usable before any constructor has run; line 0 stands for
+// allocations outside any statement (runtime start-up and shutdown). The
+// report goes to stderr at exit, and as JSON to the file named by
+// $BIF_MEM_STATS.
+constexpr std::string_view kCppMemStatsRuntime = R"(
+#include <new>
+
+struct BifMemLine {
+    uint64_t allocations;
+    uint64_t bytes;
+    uint64_t live;
+    uint64_t peak;
+};
+
+struct BifMemStats {
+    ~BifMemStats() {
+        report();
+    }
+
+    void* allocate(std::size_t size) {
+        void* block = std::malloc(size + kHeader);
+        if (!block) {
+            throw std::bad_alloc();
+        }
+        auto* header = static_cast<uint64_t*>(block);
+        header[0] = size;
+        header[1] = static_cast<uint64_t>(line);
+        if (!frozen) {
+            BifMemLine& entry = lines[line];
+            ++entry.allocations;
+            entry.bytes += size;
+            entry.live += size;
+            entry.peak = entry.live > entry.peak ? entry.live : entry.peak;
+            live += size;
+            peak = live > peak ? live : peak;
+        }
+        return static_cast<char*>(block) + kHeader;
+    }
+
+    void release(void* pointer) {
+        if (!pointer) {
+            return;
+        }
+        auto* header = reinterpret_cast<uint64_t*>(static_cast<char*>(pointer) - kHeader);
+        if (!frozen) {
+            lines[header[1]].live -= header[0];
+            live -= header[0];
+        }
+        std::free(header);
+    }
+
+    void report() {
+        bif_out.flush();
+        frozen = true;
+        uint64_t allocations = 0;
+        uint64_t bytes = 0;
+        std::vector<const BifSourceLine*> order;
+        for (const BifSourceLine* entry = bif_source_lines;; ++entry) {
+            const BifMemLine& stats = lines[entry->line];
+            allocations += stats.allocations;
+            bytes += stats.bytes;
+            if (stats.allocations > 0) {
+                order.push_back(entry);
+            }
+            if (entry->line == 0) {
+                break;
+            }
+        }
+        std::stable_sort(order.begin(), order.end(), [&](const BifSourceLine* a, const BifSourceLine* b) {
+            return lines[a->line].bytes > lines[b->line].bytes;
+        });
+
+        std::fprintf(stderr, "\nbif mem-stats: %llu allocations, %llu bytes, peak %llu bytes live\n",
+                     static_cast<unsigned long long>(allocations), static_cast<unsigned long long>(bytes),
+                     static_cast<unsigned long long>(peak));
+        std::fprintf(stderr, "%6s %12s %14s %14s  %s\n", "line", "allocs", "bytes", "peak live", "source");
+        for (const BifSourceLine* entry : order) {
+            const BifMemLine& stats = lines[entry->line];
+            std::fprintf(stderr, "%6d %12llu %14llu %14llu  %s\n", entry->line,
+                         static_cast<unsigned long long>(stats.allocations),
+                         static_cast<unsigned long long>(stats.bytes), static_cast<unsigned long long>(stats.peak),
+                         entry->line ? entry->source : "<runtime>");
+        }
+
+        std::FILE* json = bif_open_report("BIF_MEM_STATS");
+        if (!json) {
+            return;
+        }
+        std::fprintf(json, "{\"allocations\": %llu, \"bytes\": %llu, \"peak_live_bytes\": %llu, \"lines\": [",
+                     static_cast<unsigned long long>(allocations), static_cast<unsigned long long>(bytes),
+                     static_cast<unsigned long long>(peak));
+        for (size_t i = 0; i < order.size(); ++i) {
+            const BifMemLine& stats = lines[order[i]->line];
+            std::fprintf(json,
+                         "%s\n  {\"line\": %d, \"allocations\": %llu, \"bytes\": %llu, \"peak_live_bytes\": %llu, "
+                         "\"source\": ",
+                         i > 0 ? "," : "", order[i]->line, static_cast<unsigned long long>(stats.allocations),
+                         static_cast<unsigned long long>(stats.bytes), static_cast<unsigned long long>(stats.peak));
+            bif_json_string(json, order[i]->line ? order[i]->source : "<runtime>");
+            std::fputc('}', json);
+        }
+        std::fputs("\n]}\n", json);
+        std::fclose(json);
+    }
+
+    static constexpr std::size_t kHeader = 16;
+    BifMemLine lines[bif_max_line + 1];
+    uint64_t live;
+    uint64_t peak;
+    int line;
+    bool frozen;
+};
+
+BifMemStats bif_mem;
+
+void* operator new(std::size_t size) {
+    return bif_mem.allocate(size);
+}
+
+void* operator new[](std::size_t size) {
+    return bif_mem.allocate(size);
+}
+
+void operator delete(void* pointer) noexcept {
+    bif_mem.release(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    bif_mem.release(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+    bif_mem.release(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept {
+    bif_mem.release(pointer);
+}
+
+)";
+
+// Helpers that need <cmath>, added when the program includes it.
+constexpr std::string_view kCppMathRuntime = R"(
+// Float `%` takes the sign of the divisor, as in Python.
+inline double bif_float_mod(double lhs, double rhs) {
+    double rest = std::fmod(lhs, rhs);
+    if (rest == 0.0) {
+        return std::copysign(0.0, rhs);
+    }
+    return ((rest < 0.0) != (rhs < 0.0)) ? rest + rhs : rest;
+}
+)";
+
+// With `chunk` the prelude of one chunk of a split build: the same headers
+// and runtime, without the definition of bif_out and without main().
+// Chunks always include <cmath>, so the prelude (part of every chunk's
+// object key) does not change when one `**` appears somewhere.
+std::string cpp_prelude(const TranspileResult& result, bool chunk = false) {
+    static const std::unordered_map<std::string, std::string> using_lines = {
+        {"BIFMath", "using bif::math::BIFMath;"},
+        {"BIFitertools", "using bif::itertools::BIFitertools;"},
+        {"BIFtkinter", "using bif::tkinter::BIFWindow;"},
+    };
+
+    std::string out;
+    if (result.uses_cmath || chunk) {
+        out += "#include <cmath>\n";
+    }
+    out += kCppIncludes;
+    out += "\n";
+
+    for (const auto& module_name : result.imports) {
+        auto it = library_headers().find(module_name);
+        if (it != library_headers().end()) {
+            out += "#include \"" + it->second + "\"\n";
+        }
+    }
+
+    out += "\n";
+    for (const auto& module_name : result.imports) {
+        auto it = using_lines.find(module_name);
+        if (it != using_lines.end()) {
+            out += it->second + "\n";
+        }
+    }
+
+    out += kCppRuntime;
+    if (result.uses_cmath || chunk) {
+        out += kCppMathRuntime;
+    }
+    if (chunk) {
+        return out + "\n";
+    }
+    out += result.flush_lines ? "BifOutput bif_out(true);\n" : "BifOutput bif_out(false);\n";
+    if (!result.line_table.empty()) {
+        out += kCppLineRuntime;
+        out += result.line_table;
+        if (result.profile) {
+            out += kCppProfileRuntime;
+        }
+        if (result.mem_stats) {
+            out += kCppMemStatsRuntime;
+        }
+        out += "\ninline void bif_line(int line) {\n";
+        out += result.profile ? "    bif_profile.enter(line);\n" : "";
+        out += result.mem_stats ? "    bif_mem.line = line;\n" : "";
+        out += "}\n";
+    }
+    if (!result.globals.empty()) {
+        out += "\n" + result.globals;
+    }
+    out += "\nint main() {\n";
+    return out;
+}
+
+constexpr std::string_view kCppEpilogue = "    return 0;\n}\n";
+
+// Stamp kept next to the generated file: content hash plus the size and
+// mtime the file had when bifc wrote it, so external edits are noticed too.
+std::string cpp_stamp(const std::string& digest, const fs::path& path) {
+    std::error_code ec;
+    auto size = fs::file_size(path, ec);
+    if (ec) {
+        return "";
+    }
+    auto mtime = fs::last_write_time(path, ec);
+    if (ec) {
+        return "";
+    }
+    return digest + " " + std::to_string(size) + " " + std::to_string(mtime.time_since_epoch().count()) + "\n";
+}
+
+struct WrittenCpp {
+    bool changed;
+    std::string digest;
+};
+
+WrittenCpp write_cpp(const fs::path& output_path, const TranspileResult& result) {
+    std::string prelude = cpp_prelude(result);
+
+    ContentHash hash;
+    hash.update(prelude);
+    hash.update(result.body);
+    hash.update(kCppEpilogue);
+    std::string digest = hash.hex();
+
+    fs::path stamp_path = output_path;
+    stamp_path += ".hash";
+    std::string current = cpp_stamp(digest, output_path);
+    if (!current.empty() && read_file_text(stamp_path) == current) {
+        return {false, digest};
+    }
+
+    std::FILE* out = std::fopen(output_path.string().c_str(), "wb");
+    if (!out) {
+        return {true, digest};
+    }
+    std::fwrite(prelude.data(), 1, prelude.size(), out);
+    std::fwrite(result.body.data(), 1, result.body.size(), out);
+    std::fwrite(kCppEpilogue.data(), 1, kCppEpilogue.size(), out);
+    std::fclose(out);
+
+    std::ofstream stamp(stamp_path, std::ios::binary);
+    stamp << cpp_stamp(digest, output_path);
+    return {true, digest};
+}
+
+#ifdef _WIN32
+std::string quote_arg(const std::string& value) {
+    if (value.find(' ') == std::string::npos) {
+        return value;
+    }
+    return "\"" + value + "\"";
+}
+#endif
+
+#ifdef _WIN32
+constexpr const char* kNullDevice = "NUL";
+#else
+constexpr const char* kNullDevice = "/dev/null";
+#endif
+
+// Runs `program` (looked up in PATH unless it is a path) with `args` and
+// waits for it. `input` replaces stdin and `output` stdout and stderr when
+// given. Returns the exit code; a program killed by a signal gives 128 plus
+// the signal number, as in a shell, and one that cannot be started 127. On
+// POSIX this is a posix_spawn with an explicit argv, no shell in between.
+int run_process(
+    const std::string& program,
+    const std::vector<std::string>& args,
+    const fs::path& input = {},
+    const fs::path& output = {}) {
+#ifdef _WIN32
+    std::string command = quote_arg(program);
+    for (const auto& arg : args) {
+        command += " " + quote_arg(arg);
+    }
+    if (!input.empty()) {
+        command += " < " + quote_arg(input.string());
+    }
+    if (!output.empty()) {
+        command += " > " + quote_arg(output.string()) + " 2>&1";
+    }
+    return std::system(command.c_str());
+#else
+    std::vector<char*> argv;
+    argv.push_back(const_cast<char*>(program.c_str()));
+    for (const auto& arg : args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    std::string input_path = input.string();
+    std::string output_path = output.string();
+    if (!input.empty()) {
+        posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, input_path.c_str(), O_RDONLY, 0);
+    }
+    if (!output.empty()) {
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, output_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                                         0644);
+        posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+    }
+    pid_t pid = 0;
+    int error = posix_spawnp(&pid, program.c_str(), &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (error != 0) {
+        return 127;
+    }
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return 127;
+        }
+    }
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+    return WIFSIGNALED(status) ? 128 + WTERMSIG(status) : 127;
+#endif
+}
+
+// Build profiles (--opt). Default is -O2; fast compiles quickest, release
+// and pgo produce the fastest programs (pgo adds a training run, see
+// compile_pgo()).
+enum class OptLevel {
+    Default,
+    Fast,
+    Release,
+    Pgo,
+};
+
+// Flags shared by every g++ call of a build: the program, its PCH and its
+// cache key. `native` adds -march=native (release and pgo only).
+std::vector<std::string> compile_flags(OptLevel level = OptLevel::Default, bool native = false) {
+    std::vector<std::string> flags = {"-std=c++17"};
+    switch (level) {
+        case OptLevel::Default:
+            flags.push_back("-O2");
+            break;
+        case OptLevel::Fast:
+            flags.push_back("-O0");
+            break;
+        case OptLevel::Release:
+        case OptLevel::Pgo:
+            flags.push_back("-O3");
+            break;
+    }
+    if (native) {
+        flags.push_back("-march=native");
+    }
+    return flags;
+}
+
+// Output of the tool goes to `log_path` when one is given, otherwise to the
+// terminal bifc runs in.
+int run_tool(const std::string& program, const std::vector<std::string>& args, const fs::path& log_path = {}) {
+    return run_process(program, args, {}, log_path);
+}
+
+// Caps how many g++ processes run at once (-j), shared by batch workers and
+// --serve requests.
+class JobSlots {
+public:
+    static JobSlots& compiler() {
+        static JobSlots slots;
+        return slots;
+    }
+
+    void set_limit(unsigned limit) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        limit_ = std::max(1u, limit);
+        released_.notify_all();
+    }
+
+    void acquire() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        released_.wait(lock, [this]() { return used_ < limit_; });
+        ++used_;
+    }
+
+    void release() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            --used_;
+        }
+        released_.notify_one();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable released_;
+    unsigned limit_ = std::max(1u, std::thread::hardware_concurrency());
+    unsigned used_ = 0;
+};
+
+int run_gxx(const std::vector<std::string>& args, const fs::path& log_path = {}) {
+    JobSlots& slots = JobSlots::compiler();
+    slots.acquire();
+    // -pipe: cc1plus hands its assembly to as through a pipe instead of a
+    // temporary file.
+    std::vector<std::string> piped = {"-pipe"};
+    piped.insert(piped.end(), args.begin(), args.end());
+    int result = run_tool("g++", piped, log_path);
+    slots.release();
+    return result;
+}
+
+// Links against `library` (libbif.a) when given; the caller adds -flto to
+// `flags` when small library functions should be inlined into main().
+// `objects` are linked in as well (the chunks of a split build).
+int compile_cpp(
+    const std::vector<std::string>& flags,
+    const fs::path& cpp_path,
+    const fs::path& exe_path,
+    const fs::path& include_dir,
+    const fs::path& pch_header,
+    const fs::path& library,
+    const fs::path& log_path,
+    const std::vector<fs::path>& objects = {}) {
+    TraceScope trace("g++");
+    std::vector<std::string> args = flags;
+    if (!pch_header.empty()) {
+        args.push_back("-include");
+        args.push_back(pch_header.string());
+    }
+    args.insert(args.end(), {cpp_path.string(), "-I", include_dir.string(), "-o", exe_path.string()});
+    for (const auto& object : objects) {
+        args.push_back(object.string());
+    }
+    if (!library.empty()) {
+        args.push_back(library.string());
+    }
+    return run_gxx(args, log_path);
+}
+
+std::string env_or_empty(const char* name) {
+    const char* value = std::getenv(name);
+    return value ? std::string(value) : std::string();
+}
+
+fs::path find_in_path(const std::string& program) {
+#ifdef _WIN32
+    const char separator = ';';
+    const std::string suffix = ".exe";
+#else
+    const char separator = ':';
+    const std::string suffix;
+#endif
+    std::stringstream dirs(env_or_empty("PATH"));
+    std::string dir;
+    while (std::getline(dirs, dir, separator)) {
+        if (dir.empty()) {
+            continue;
+        }
+        std::error_code ec;
+        fs::path candidate = fs::path(dir) / (program + suffix);
+        if (fs::is_regular_file(candidate, ec)) {
+            return fs::canonical(candidate, ec);
+        }
+    }
+    return {};
+}
+
+// Identifies the g++ that compile_cpp will run without spawning it:
+// the resolved binary path with its size and mtime.
+std::string compiler_identity() {
+    static const fs::path compiler = find_in_path("g++");
+    if (compiler.empty()) {
+        return "g++";
+    }
+    std::error_code ec;
+    auto size = fs::file_size(compiler, ec);
+    auto mtime = fs::last_write_time(compiler, ec);
+    return compiler.string() + " " + std::to_string(size) + " " + std::to_string(mtime.time_since_epoch().count());
+}
+
+// Digest of one file's contents, remembered by path, size and mtime so a
+// long-running --serve process only re-reads library files that changed.
+std::string file_digest(const fs::path& path) {
+    struct Entry {
+        uintmax_t size;
+        fs::file_time_type mtime;
+        std::string digest;
+    };
+    static std::mutex mutex;
+    static std::unordered_map<std::string, Entry> entries;
+
+    std::error_code ec;
+    uintmax_t size = fs::file_size(path, ec);
+    fs::file_time_type mtime = fs::last_write_time(path, ec);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(path.string());
+        if (!ec && it != entries.end() && it->second.size == size && it->second.mtime == mtime) {
+            return it->second.digest;
+        }
+    }
+
+    ContentHash hash;
+    hash.update(read_file_text(path));
+    std::string digest = hash.hex();
+    if (!ec) {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries[path.string()] = Entry{size, mtime, digest};
+    }
+    return digest;
+}
+
+void hash_file(ContentHash& hash, const fs::path& path) {
+    hash.update(path.filename().string());
+    hash.update(file_digest(path));
+}
+
+// Hashes the files of every imported library directory whose extension
+// matches `extension` (all files when it is empty).
+void hash_library_files(
+    ContentHash& hash,
+    const std::vector<std::string>& imports,
+    const fs::path& repo_root,
+    const std::string& extension) {
+    for (const auto& module_name : imports) {
+        auto it = library_headers().find(module_name);
+        if (it == library_headers().end()) {
+            continue;
+        }
+        std::vector<fs::path> files;
+        std::error_code ec;
+        for (const auto& entry : fs::directory_iterator((repo_root / it->second).parent_path(), ec)) {
+            if (entry.is_regular_file(ec) && (extension.empty() || entry.path().extension() == extension)) {
+                files.push_back(entry.path());
+            }
+        }
+        std::sort(files.begin(), files.end());
+        for (const auto& file : files) {
+            hash_file(hash, file);
+        }
+    }
+}
+
+// Cache key of an executable: generated C++, every file of the imported
+// libraries, the compiler and the flags it is invoked with.
+std::string build_key(
+    const std::string& cpp_digest,
+    const std::vector<std::string>& imports,
+    const fs::path& repo_root,
+    const std::vector<std::string>& flags) {
+    ContentHash hash;
+    hash.update(cpp_digest);
+    hash_library_files(hash, imports, repo_root, "");
+    hash.update(compiler_identity());
+    for (const auto& flag : flags) {
+        hash.update(flag);
+        hash.update(" ");
+    }
+    return hash.hex();
+}
+
+// Suffix for a scratch file that is renamed into place, unique across the
+// processes and threads that may be filling the same cache entry.
+std::string temp_suffix() {
+    static std::atomic<unsigned long long> counter{0};
+    auto now = static_cast<unsigned long long>(std::chrono::steady_clock::now().time_since_epoch().count());
+    return ".tmp" + std::to_string(now) + "-" + std::to_string(counter++);
+}
+
+uintmax_t parse_size(const std::string& text, uintmax_t fallback) {
+    if (text.empty()) {
+        return fallback;
+    }
+    char* end = nullptr;
+    unsigned long long value = std::strtoull(text.c_str(), &end, 10);
+    if (end == text.c_str()) {
+        return fallback;
+    }
+    switch (*end) {
+        case 'k':
+        case 'K':
+            return value << 10;
+        case 'm':
+        case 'M':
+            return value << 20;
+        case 'g':
+        case 'G':
+            return value << 30;
+        default:
+            return value;
+    }
+}
+
+// Content-addressed store of compiled executables, precompiled preludes and
+// libbif builds shared by every checkout and --outdir. Executables are plain
+// files under exe/ named by build_key(); preludes and libraries are
+// directories under pch/ and lib/. The mtime
+// of an entry is bumped on every hit and the least recently used entries are
+// evicted once the store grows past its size cap.
+class BuildCache {
+public:
+    BuildCache(fs::path root, uintmax_t max_bytes) : root_(std::move(root)), max_bytes_(max_bytes) {}
+
+    static fs::path default_root() {
+        std::string dir = env_or_empty("BIFC_CACHE_DIR");
+        if (!dir.empty()) {
+            return dir;
+        }
+#ifdef _WIN32
+        dir = env_or_empty("LOCALAPPDATA");
+        if (!dir.empty()) {
+            return fs::path(dir) / "bifc";
+        }
+#else
+        dir = env_or_empty("XDG_CACHE_HOME");
+        if (!dir.empty()) {
+            return fs::path(dir) / "bifc";
+        }
+        dir = env_or_empty("HOME");
+        if (!dir.empty()) {
+            return fs::path(dir) / ".cache" / "bifc";
+        }
+#endif
+        return fs::temp_directory_path() / "bifc-cache";
+    }
+
+    static uintmax_t default_max_bytes() {
+        return parse_size(env_or_empty("BIFC_CACHE_MAX"), uintmax_t(512) << 20);
+    }
+
+    const fs::path& root() const {
+        return root_;
+    }
+
+    bool fetch(const std::string& key, const fs::path& dest) {
+        std::error_code ec;
+        fs::path entry = entry_path(key);
+        if (!fs::is_regular_file(entry, ec)) {
+            return false;
+        }
+        fs::path temp = dest;
+        temp += temp_suffix();
+        if (!fs::copy_file(entry, temp, fs::copy_options::overwrite_existing, ec)) {
+            fs::remove(temp, ec);
+            return false;
+        }
+        fs::rename(temp, dest, ec);
+        if (ec) {
+            fs::remove(temp, ec);
+            return false;
+        }
+        fs::last_write_time(entry, fs::file_time_type::clock::now(), ec);
+        return true;
+    }
+
+    void store(const std::string& key, const fs::path& source) {
+        std::error_code ec;
+        fs::create_directories(root_ / "exe", ec);
+        fs::path entry = entry_path(key);
+        fs::path temp = entry;
+        temp += temp_suffix();
+        if (!fs::copy_file(source, temp, fs::copy_options::overwrite_existing, ec)) {
+            return;
+        }
+        fs::rename(temp, entry, ec);
+        if (ec) {
+            fs::remove(temp, ec);
+            return;
+        }
+        evict();
+    }
+
+    // Precompiled header with the standard library and the headers of
+    // `imports`, built once per module set, compiler and flags. Returns the
+    // header to pass to g++ with -include, or an empty path if it could not
+    // be built (compilation then simply goes without it).
+    fs::path prelude_pch(
+        std::vector<std::string> imports,
+        const fs::path& repo_root,
+        const std::vector<std::string>& flags = compile_flags(),
+        const fs::path& log_path = {}) {
+        TraceScope trace("PCH");
+        static std::mutex building;
+        std::lock_guard<std::mutex> lock(building);
+        std::sort(imports.begin(), imports.end());
+        ContentHash hash;
+        hash.update("prelude-pch-v6");
+        for (const auto& module_name : imports) {
+            hash.update(module_name);
+            hash.update(" ");
+        }
+        hash_library_files(hash, imports, repo_root, ".h");
+        hash.update(compiler_identity());
+        for (const auto& flag : flags) {
+            hash.update(flag);
+            hash.update(" ");
+        }
+
+        std::error_code ec;
+        fs::path dir = root_ / "pch" / hash.hex();
+        fs::path header = dir / "bif_prelude.h";
+        fs::path gch = dir / "bif_prelude.h.gch";
+        if (fs::is_regular_file(gch, ec)) {
+            fs::last_write_time(dir, fs::file_time_type::clock::now(), ec);
+            return header;
+        }
+
+        fs::create_directories(dir, ec);
+        std::string text = "#include <cmath>\n" + std::string(kCppIncludes);
+        for (const auto& module_name : imports) {
+            auto it = library_headers().find(module_name);
+            if (it != library_headers().end()) {
+                text += "#include \"" + it->second + "\"\n";
+            }
+        }
+        std::ofstream(header, std::ios::binary) << text;
+
+        fs::path temp = gch;
+        temp += temp_suffix();
+        std::vector<std::string> args = flags;
+        args.insert(args.end(), {"-x", "c++-header", header.string(), "-I", repo_root.string(), "-o", temp.string()});
+        if (run_gxx(args, log_path) != 0) {
+            fs::remove(temp, ec);
+            return {};
+        }
+        fs::rename(temp, gch, ec);
+        if (ec) {
+            fs::remove(temp, ec);
+            return {};
+        }
+        evict();
+        return header;
+    }
+
+    // libbif.a with every module in library_sources(), compiled once per
+    // library source state, compiler and flags. Objects are fat LTO objects,
+    // so both -flto and plain links work. Returns an empty path on failure.
+    fs::path library(const fs::path& repo_root) {
+        TraceScope trace("libbif.a");
+        static std::mutex building;
+        std::lock_guard<std::mutex> lock(building);
+        std::vector<std::string> modules;
+        for (const auto& entry : library_sources()) {
+            modules.push_back(entry.first);
+        }
+        std::sort(modules.begin(), modules.end());
+        ContentHash hash;
+        hash.update("libbif-v1");
+        hash_library_files(hash, modules, repo_root, "");
+        hash.update(compiler_identity());
+        for (const auto& flag : compile_flags()) {
+            hash.update(flag);
+            hash.update(" ");
+        }
+
+        std::error_code ec;
+        fs::path dir = root_ / "lib" / hash.hex();
+        fs::path archive = dir / "libbif.a";
+        if (fs::is_regular_file(archive, ec)) {
+            fs::last_write_time(dir, fs::file_time_type::clock::now(), ec);
+            return archive;
+        }
+
+        fs::path temp = dir;
+        temp += temp_suffix();
+        fs::create_directories(temp, ec);
+        std::vector<std::string> ar_args = {"rcs", (temp / "libbif.a").string()};
+        for (const auto& module_name : modules) {
+            fs::path object = temp / (module_name + ".o");
+            std::vector<std::string> args = compile_flags();
+            args.insert(
+                args.end(),
+                {"-flto", "-ffat-lto-objects", "-c", (repo_root / library_sources().at(module_name)).string(),
+                 "-I", repo_root.string(), "-o", object.string()});
+            if (run_gxx(args) != 0) {
+                fs::remove_all(temp, ec);
+                return {};
+            }
+            ar_args.push_back(object.string());
+        }
+        std::string archiver = find_in_path("gcc-ar").empty() ? "ar" : "gcc-ar";
+        if (run_tool(archiver, ar_args) != 0) {
+            fs::remove_all(temp, ec);
+            return {};
+        }
+        fs::rename(temp, dir, ec);
+        if (ec) {
+            fs::remove_all(temp, ec);
+            return fs::is_regular_file(archive, ec) ? archive : fs::path();
+        }
+        evict();
+        return archive;
+    }
+
+    // Training data of one --opt=pgo build, named by its build key.
+    fs::path pgo_dir(const std::string& key) {
+        std::error_code ec;
+        fs::path dir = root_ / "pgo" / key;
+        fs::create_directories(dir, ec);
+        fs::last_write_time(dir, fs::file_time_type::clock::now(), ec);
+        return dir;
+    }
+
+private:
+    fs::path entry_path(const std::string& key) const {
+        return root_ / "exe" / key;
+    }
+
+    void evict() {
+        struct Entry {
+            fs::path path;
+            fs::file_time_type used;
+            uintmax_t size;
+        };
+        std::vector<Entry> entries;
+        uintmax_t total = 0;
+        std::error_code ec;
+        for (const auto& item : fs::directory_iterator(root_ / "exe", ec)) {
+            if (item.is_regular_file(ec)) {
+                entries.push_back({item.path(), item.last_write_time(ec), item.file_size(ec)});
+                total += entries.back().size;
+            }
+        }
+        for (const char* kind : {"pch", "lib", "pgo"}) {
+            for (const auto& item : fs::directory_iterator(root_ / kind, ec)) {
+                if (!item.is_directory(ec)) {
+                    continue;
+                }
+                uintmax_t size = 0;
+                for (const auto& file : fs::recursive_directory_iterator(item.path(), ec)) {
+                    size += file.is_regular_file(ec) ? file.file_size(ec) : 0;
+                }
+                entries.push_back({item.path(), item.last_write_time(ec), size});
+                total += size;
+            }
+        }
+        if (total <= max_bytes_) {
+            return;
+        }
+        std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.used < b.used; });
+        for (const auto& entry : entries) {
+            if (total <= max_bytes_) {
+                break;
+            }
+            if (fs::remove_all(entry.path, ec) > 0) {
+                total -= entry.size;
+            }
+        }
+    }
+
+    fs::path root_;
+    uintmax_t max_bytes_;
+};
+
+int run_exe(const fs::path& exe_path) {
+    return run_process(exe_path.string(), {});
+}
+
+// --opt=pgo: builds `cpp_path` instrumented, runs it once with `sample` on
+// stdin (no input when empty), then rebuilds it with the recorded profile.
+// Both builds happen inside the cache's pgo directory for `key`, so the
+// profile file names (derived by g++ from the output path) always match; a
+// later build with the same key skips straight to the second step.
+int compile_pgo(
+    BuildCache& cache,
+    const std::string& key,
+    const std::vector<std::string>& flags,
+    const fs::path& cpp_path,
+    const fs::path& exe_path,
+    const fs::path& include_dir,
+    const fs::path& pch_header,
+    const fs::path& library,
+    const fs::path& sample,
+    const fs::path& log_path,
+    std::ostream& err) {
+    static std::mutex training;
+    std::lock_guard<std::mutex> lock(training);
+    fs::path dir = cache.pgo_dir(key);
+    fs::path build = dir / "program.exe";
+    fs::path trained = dir / "trained";
+    std::error_code ec;
+    if (!fs::exists(trained, ec)) {
+        std::vector<std::string> generate = flags;
+        generate.push_back("-fprofile-generate=" + dir.string());
+        int result = compile_cpp(generate, cpp_path, build, include_dir, pch_header, library, log_path);
+        if (result != 0) {
+            return result;
+        }
+        TraceScope trace("PGO training run");
+        if (run_process(build.string(), {}, sample.empty() ? fs::path(kNullDevice) : sample, kNullDevice) != 0) {
+            err << "PGO training run exited with an error; using the profile it recorded." << std::endl;
+        }
+        std::ofstream(trained, std::ios::binary) << (sample.empty() ? "(no input)" : sample.string()) << "\n";
+    }
+    std::vector<std::string> use = flags;
+    use.insert(use.end(), {"-fprofile-use=" + dir.string(), "-fprofile-partial-training", "-Wno-missing-profile"});
+    int result = compile_cpp(use, cpp_path, build, include_dir, pch_header, library, log_path);
+    if (result != 0) {
+        return result;
+    }
+    fs::copy_file(build, exe_path, fs::copy_options::overwrite_existing, ec);
+    fs::remove(build, ec);
+    return ec ? 1 : 0;
+}
+
+// Split builds: compiles every chunk of `result` to `dir`/<digest>.o, where
+// <digest> hashes the chunk's whole translation unit. An object is reused
+// while its .key (build_key() of the unit) still matches, otherwise it is
+// fetched from `cache` (null with --no-cache) or compiled, several at once
+// under the -j limit. Files of chunks the program no longer has are
+// removed. On success `objects` lists the objects in chunk order.
+int compile_chunks(
+    const TranspileResult& result,
+    const fs::path& dir,
+    const fs::path& repo_root,
+    const std::vector<std::string>& flags,
+    const fs::path& pch_header,
+    BuildCache* cache,
+    std::ostream& err,
+    std::vector<fs::path>& objects) {
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+    std::string prelude = cpp_prelude(result, true);
+    std::vector<std::string> digests;
+    for (const auto& chunk : result.chunks) {
+        ContentHash hash;
+        hash.update(prelude);
+        hash.update(chunk);
+        digests.push_back(hash.hex());
+    }
+    std::vector<std::string> object_flags = flags;
+    object_flags.push_back("-c");
+
+    std::atomic<size_t> next{0};
+    std::atomic<int> failed{0};
+    std::mutex mutex;
+    auto worker = [&]() {
+        while (true) {
+            size_t index = next++;
+            if (index >= digests.size()) {
+                return;
+            }
+            const std::string& digest = digests[index];
+            fs::path object = dir / (digest + ".o");
+            fs::path key_path = object;
+            key_path += ".key";
+            std::string key = build_key(digest, result.imports, repo_root, object_flags);
+            if (fs::exists(object) && read_file_text(key_path) == key) {
+                continue;
+            }
+            if (!cache || !cache->fetch(key, object)) {
+                fs::path cpp_path = dir / (digest + ".cpp");
+                fs::path log_path = dir / (digest + ".log");
+                std::ofstream(cpp_path, std::ios::binary) << prelude << result.chunks[index];
+                int code = compile_cpp(object_flags, cpp_path, object, repo_root, pch_header, {}, log_path);
+                std::string log = read_file_text(log_path);
+                std::error_code remove_ec;
+                fs::remove(log_path, remove_ec);
+                if (!log.empty()) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    err << log;
+                }
+                if (code != 0) {
+                    failed = code;
+                    continue;
+                }
+                if (cache) {
+                    cache->store(key, object);
+                }
+            }
+            std::ofstream(key_path, std::ios::binary) << key;
+        }
+    };
+    std::vector<std::thread> threads;
+    size_t thread_count = std::min<size_t>(digests.size(), std::max(1u, std::thread::hardware_concurrency()));
+    for (size_t i = 1; i < thread_count; ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    if (failed != 0) {
+        return failed;
+    }
+
+    std::unordered_set<std::string> current(digests.begin(), digests.end());
+    for (const auto& entry : fs::directory_iterator(dir, ec)) {
+        std::string name = entry.path().filename().string();
+        if (!current.count(name.substr(0, name.find('.')))) {
+            fs::remove(entry.path(), ec);
+        }
+    }
+    for (const auto& digest : digests) {
+        objects.push_back(dir / (digest + ".o"));
+    }
+    return 0;
+}
+
+std::vector<std::string_view> split_lines(std::string_view text) {
+    std::vector<std::string_view> lines;
+    lines.reserve(text.size() / 32 + 1);
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find('\n', start);
+        if (end == std::string_view::npos) {
+            lines.push_back(text.substr(start));
+            break;
+        }
+        lines.push_back(text.substr(start, end - start));
+        start = end + 1;
+    }
+    return lines;
+}
+
+// Whole source of one .bif file. Regular files are memory-mapped and handed
+// to the parser as line views without copying; stdin, pipes and platforms
+// without mmap are read into an owned buffer instead.
+class SourceBuffer {
+public:
+    SourceBuffer() = default;
+    SourceBuffer(const SourceBuffer&) = delete;
+    SourceBuffer& operator=(const SourceBuffer&) = delete;
+
+    ~SourceBuffer() {
+#ifndef _WIN32
+        if (mapped_) {
+            munmap(mapped_, mapped_size_);
         }
-        int indent = static_cast<int>(first_non_space);
-        if (indent % 4 != 0) {
-            throw ParseError{"Line " + std::to_string(lineno) + ": Indentation must be multiples of 4 spaces."};
+#endif
+    }
+
+    bool open(const fs::path& path) {
+#ifndef _WIN32
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
         }
-        if (indent > indent_stack.back()) {
-            if (!expect_indent) {
-                throw ParseError{"Line " + std::to_string(lineno) + ": Unexpected indentation."};
+        struct stat info;
+        bool ok = fstat(fd, &info) == 0;
+        if (ok && S_ISREG(info.st_mode) && info.st_size > 0) {
+            size_t size = static_cast<size_t>(info.st_size);
+            void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                madvise(data, size, MADV_SEQUENTIAL);
+                mapped_ = data;
+                mapped_size_ = size;
+                text_ = std::string_view(static_cast<const char*>(data), size);
+            } else {
+                ok = read_fd(fd);
             }
-            indent_stack.push_back(indent);
-            expect_indent = false;
-        }
-        while (indent < indent_stack.back()) {
-            out.push_back("}");
-            indent_stack.pop_back();
+        } else if (ok) {
+            ok = read_fd(fd);
         }
-        if (expect_indent && indent == indent_stack.back()) {
-            throw ParseError{"Line " + std::to_string(lineno) + ": Expected indented block."};
+        ::close(fd);
+        return ok;
+#else
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            return false;
         }
+        std::ostringstream ss;
+        ss << in.rdbuf();
+        owned_ = ss.str();
+        text_ = owned_;
+        return true;
+#endif
+    }
 
-        std::string stripped = line.substr(first_non_space);
+    bool read_stdin() {
+#ifndef _WIN32
+        return read_fd(STDIN_FILENO);
+#else
+        std::ostringstream ss;
+        ss << std::cin.rdbuf();
+        owned_ = ss.str();
+        text_ = owned_;
+        return true;
+#endif
+    }
 
-        if (stripped.rfind("import ", 0) == 0) {
-            std::string module_name = stripped.substr(7);
-            module_name.erase(0, module_name.find_first_not_of(' '));
-            if (known_imports.find(module_name) == known_imports.end()) {
-                throw ParseError{"Line " + std::to_string(lineno) + ": Unknown module '" + module_name + "'."};
-            }
-            if (std::find(imports.begin(), imports.end(), module_name) == imports.end()) {
-                imports.push_back(module_name);
-            }
-            continue;
-        }
+    std::string_view text() const {
+        return text_;
+    }
 
-        if (stripped.rfind("from ", 0) == 0) {
-            size_t pos = stripped.find(" import ");
-            if (pos == std::string::npos) {
-                throw ParseError{"Line " + std::to_string(lineno) + ": Invalid import syntax."};
-            }
-            std::string module_name = stripped.substr(5, pos - 5);
-            module_name.erase(0, module_name.find_first_not_of(' '));
-            module_name.erase(module_name.find_last_not_of(' ') + 1);
-            if (known_imports.find(module_name) == known_imports.end()) {
-                throw ParseError{"Line " + std::to_string(lineno) + ": Unknown module '" + module_name + "'."};
-            }
-            if (std::find(imports.begin(), imports.end(), module_name) == imports.end()) {
-                imports.push_back(module_name);
-            }
-            std::string names_part = stripped.substr(pos + 8);
-            std::stringstream ss(names_part);
-            std::string name;
-            bool has_name = false;
-            while (std::getline(ss, name, ',')) {
-                name.erase(0, name.find_first_not_of(' '));
-                name.erase(name.find_last_not_of(' ') + 1);
-                if (name.empty()) {
+private:
+#ifndef _WIN32
+    bool read_fd(int fd) {
+        char chunk[64 * 1024];
+        while (true) {
+            ssize_t count = ::read(fd, chunk, sizeof(chunk));
+            if (count < 0) {
+                if (errno == EINTR) {
                     continue;
                 }
-                has_name = true;
-                if (!is_valid_identifier(name)) {
-                    throw ParseError{"Line " + std::to_string(lineno) + ": Invalid import name '" + name + "'."};
-                }
-                imported_names[name] = module_name;
+                return false;
             }
-            if (!has_name) {
-                throw ParseError{"Line " + std::to_string(lineno) + ": No imports listed."};
+            if (count == 0) {
+                break;
             }
-            continue;
+            owned_.append(chunk, static_cast<size_t>(count));
         }
+        text_ = owned_;
+        return true;
+    }
 
-        if (stripped.rfind("for ", 0) == 0 && stripped.back() == ':') {
-            std::string header = stripped.substr(4, stripped.size() - 5);
-            size_t in_pos = header.find(" in ");
-            if (in_pos == std::string::npos) {
-                throw ParseError{"Line " + std::to_string(lineno) + ": Invalid for-loop syntax."};
-            }
-            std::string name = header.substr(0, in_pos);
-            std::string iterable = header.substr(in_pos + 4);
-            name.erase(0, name.find_first_not_of(' '));
-            name.erase(name.find_last_not_of(' ') + 1);
-            iterable.erase(0, iterable.find_first_not_of(' '));
-            iterable.erase(iterable.find_last_not_of(' ') + 1);
+    void* mapped_ = nullptr;
+    size_t mapped_size_ = 0;
+#endif
+    std::string owned_;
+    std::string_view text_;
+};
 
-            if (!is_valid_identifier(name)) {
-                throw ParseError{"Line " + std::to_string(lineno) + ": Invalid variable name."};
-            }
+struct BuildOptions {
+    std::vector<std::string> inputs;
+    std::string outdir = "build";
+    unsigned jobs = 0;
+    OptLevel opt = OptLevel::Default;
+    bool native = false;
+    // --opt=pgo training input; defaults to <input>.pgo.in next to the source.
+    std::string pgo_input;
+    std::string trace_path;
+    bool time_phases = false;
+    bool run = false;
+    bool interp = false;
+    bool use_cache = true;
+    bool use_pch = true;
+    bool unbuffered = false;
+    bool profile = false;
+    bool mem_stats = false;
+    bool serve = false;
+    bool connect = false;
+    std::string socket_path;
+};
 
-            auto items = split_top_level_args(iterable);
-            if (items.empty()) {
-                throw ParseError{"Line " + std::to_string(lineno) + ": Empty for-loop iterable."};
+// Command line of a build. Shared by main() and by requests sent to --serve.
+bool parse_build_options(const std::vector<std::string>& args, BuildOptions& options, std::ostream& err) {
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& arg = args[i];
+        if (arg == "--run") {
+            options.run = true;
+        } else if (arg == "--interp") {
+            options.interp = true;
+        } else if (arg == "--no-cache") {
+            options.use_cache = false;
+        } else if (arg == "--no-pch") {
+            options.use_pch = false;
+        } else if (arg == "--unbuffered") {
+            options.unbuffered = true;
+        } else if (arg == "--profile") {
+            options.profile = true;
+        } else if (arg == "--mem-stats") {
+            options.mem_stats = true;
+        } else if (arg.rfind("--opt=", 0) == 0) {
+            std::string level = arg.substr(6);
+            if (level == "fast") {
+                options.opt = OptLevel::Fast;
+            } else if (level == "release") {
+                options.opt = OptLevel::Release;
+            } else if (level == "pgo") {
+                options.opt = OptLevel::Pgo;
+            } else {
+                err << "Unknown build profile: " << level << " (expected fast, release or pgo)" << std::endl;
+                return false;
             }
-
-            std::string joined;
-            for (size_t i = 0; i < items.size(); ++i) {
-                if (i > 0) {
-                    joined += ", ";
-                }
-                joined += normalize_expression(items[i], imports, imported_names);
+        } else if (arg == "--native") {
+            options.native = true;
+        } else if (arg == "--time-phases") {
+            options.time_phases = true;
+        } else if (arg == "--serve") {
+            options.serve = true;
+        } else if (arg == "--connect") {
+            options.connect = true;
+        } else if (arg == "-j" || (arg.rfind("-j", 0) == 0 && arg.size() > 2)) {
+            if (arg == "-j" && i + 1 >= args.size()) {
+                err << "Missing value for -j" << std::endl;
+                return false;
             }
-
-            out.push_back("for (auto " + name + " : std::vector<double>{" + joined + "}) {");
-            expect_indent = true;
-            continue;
+            std::string value = (arg == "-j") ? args[++i] : arg.substr(2);
+            char* end = nullptr;
+            unsigned long jobs = std::strtoul(value.c_str(), &end, 10);
+            if (value.empty() || *end != '\0' || jobs == 0) {
+                err << "Invalid job count: " << value << std::endl;
+                return false;
+            }
+            options.jobs = static_cast<unsigned>(jobs);
+        } else if (arg == "--outdir" || arg == "--socket" || arg == "--pgo-input" || arg == "--trace") {
+            if (i + 1 >= args.size()) {
+                err << "Missing value for " << arg << std::endl;
+                return false;
+            }
+            std::string& value = arg == "--outdir"      ? options.outdir
+                                 : arg == "--socket"    ? options.socket_path
+                                 : arg == "--pgo-input" ? options.pgo_input
+                                                        : options.trace_path;
+            value = args[++i];
+        } else if (arg != "-" && arg.rfind("-", 0) == 0) {
+            err << "Unknown option: " << arg << std::endl;
+            return false;
+        } else {
+            options.inputs.push_back(arg);
         }
+    }
+    if ((options.profile || options.mem_stats) && options.interp) {
+        err << (options.profile ? "--profile" : "--mem-stats")
+            << " instruments the compiled program and cannot be used with --interp." << std::endl;
+        return false;
+    }
+    if (options.native && options.opt != OptLevel::Release && options.opt != OptLevel::Pgo) {
+        err << "--native needs --opt=release or --opt=pgo." << std::endl;
+        return false;
+    }
+    if (!options.pgo_input.empty() && options.opt != OptLevel::Pgo) {
+        err << "--pgo-input needs --opt=pgo." << std::endl;
+        return false;
+    }
+    return true;
+}
 
-        if (stripped.rfind("if ", 0) == 0 && stripped.back() == ':') {
-            std::string expr = stripped.substr(3, stripped.size() - 4);
-            expr.erase(expr.find_last_not_of(' ') + 1);
-            out.push_back("if (" + normalize_expression(expr, imports, imported_names) + ") {");
-            expect_indent = true;
-            continue;
-        }
+// Transpiles and compiles `input_path`, resolving relative paths against `cwd`.
+// Returns bifc's exit code; on success `exe_path` names the executable. With
+// `capture_tool_output` g++ diagnostics are copied to `err` instead of the
+// terminal.
+int build_program(
+    const BuildOptions& options,
+    const std::string& input_path,
+    const fs::path& cwd,
+    const fs::path& compiler_path,
+    std::ostream& err,
+    fs::path& exe_path,
+    bool capture_tool_output) {
+    TraceScope build_trace(options.interp ? "interpret" : "build");
+    bool from_stdin = (input_path == "-");
+    fs::path input = from_stdin ? fs::path("stdin.bif") : cwd / input_path;
+    TraceScope read_trace("read source");
+    SourceBuffer source;
+    if (from_stdin ? !source.read_stdin() : (!fs::exists(input) || !source.open(input))) {
+        err << "Input file not found." << std::endl;
+        return 1;
+    }
 
-        if (stripped.rfind("while ", 0) == 0 && stripped.back() == ':') {
-            std::string expr = stripped.substr(6, stripped.size() - 7);
-            expr.erase(expr.find_last_not_of(' ') + 1);
-            out.push_back("while (" + normalize_expression(expr, imports, imported_names) + ") {");
-            expect_indent = true;
-            continue;
-        }
+    std::vector<std::string_view> lines = split_lines(source.text());
+    read_trace.end();
+    if (options.interp) {
+        return interpret_bif(lines, options.unbuffered);
+    }
 
-        if (stripped == "else:") {
-            out.push_back("else {");
-            expect_indent = true;
-            continue;
+    TranspileResult result;
+    try {
+        TraceScope trace("transpile");
+        // Instrumented and PGO builds keep the program in one unit.
+        bool split = !options.profile && !options.mem_stats && options.opt != OptLevel::Pgo;
+        result = transpile_bif(lines, options.profile || options.mem_stats, split);
+    } catch (const ParseError& parse_error) {
+        err << parse_error.message << std::endl;
+        return 2;
+    }
+    result.flush_lines = options.unbuffered;
+    result.profile = options.profile;
+    result.mem_stats = options.mem_stats;
+
+    fs::path outdir_path = cwd / options.outdir;
+    fs::create_directories(outdir_path);
+
+    std::string base_name = input.stem().string();
+    fs::path cpp_path = outdir_path / (base_name + ".cpp");
+    exe_path = outdir_path / (base_name + (".exe"));
+
+    TraceScope write_trace("write C++");
+    WrittenCpp cpp = write_cpp(cpp_path, result);
+    write_trace.end();
+
+    TraceScope key_trace("build key");
+    fs::path repo_root = compiler_path.parent_path().parent_path();
+    std::vector<std::string> flags = compile_flags(options.opt, options.native);
+    std::string key = build_key(cpp.digest, result.imports, repo_root, flags);
+    fs::path pgo_sample;
+    if (options.opt == OptLevel::Pgo) {
+        if (!options.pgo_input.empty()) {
+            pgo_sample = cwd / options.pgo_input;
+        } else if (!from_stdin) {
+            pgo_sample = fs::path(input).replace_extension(".pgo.in");
+        }
+        if (!pgo_sample.empty() && !fs::is_regular_file(pgo_sample)) {
+            if (!options.pgo_input.empty()) {
+                err << "PGO input not found: " << options.pgo_input << std::endl;
+                return 1;
+            }
+            pgo_sample.clear();
         }
+        ContentHash hash;
+        hash.update(key);
+        hash.update(pgo_sample.empty() ? std::string("no-input") : file_digest(pgo_sample));
+        key = hash.hex();
+    }
 
-        if (stripped.rfind("print(", 0) == 0 && stripped.back() == ')') {
-            std::string expr = stripped.substr(6, stripped.size() - 7);
-            auto trimmed_start = expr.find_first_not_of(' ');
-            if (trimmed_start == std::string::npos) {
-                out.push_back("std::cout << std::endl;");
-                continue;
+    fs::path key_path = exe_path;
+    key_path += ".key";
+    bool exe_up_to_date = fs::exists(exe_path) && read_file_text(key_path) == key;
+    key_trace.end();
+
+    if (!exe_up_to_date) {
+        BuildCache cache(BuildCache::default_root(), BuildCache::default_max_bytes());
+        TraceScope fetch_trace("cache fetch");
+        bool fetched = options.use_cache && cache.fetch(key, exe_path);
+        fetch_trace.end();
+        if (!fetched) {
+            fs::path log_path;
+            if (capture_tool_output) {
+                log_path = exe_path;
+                log_path += ".log";
             }
-            auto args = split_top_level_args(expr);
-            if (args.size() == 1) {
-                out.push_back("std::cout << " + normalize_expression(args[0], imports, imported_names) + " << std::endl;");
-            } else {
-                std::string line = "std::cout";
-                for (size_t i = 0; i < args.size(); ++i) {
-                    if (i > 0) {
-                        line += " << \" \"";
-                    }
-                    line += " << " + normalize_expression(args[i], imports, imported_names);
+            auto forward_log = [&]() {
+                if (!log_path.empty()) {
+                    err << read_file_text(log_path);
+                    std::error_code ec;
+                    fs::remove(log_path, ec);
                 }
-                line += " << std::endl;";
-                out.push_back(line);
+            };
+            fs::path pch_header =
+                options.use_pch ? cache.prelude_pch(result.imports, repo_root, flags, log_path) : fs::path();
+            forward_log();
+            fs::path library;
+            bool needs_library = std::any_of(result.imports.begin(), result.imports.end(), [](const std::string& name) {
+                return library_sources().count(name) > 0;
+            });
+            if (needs_library) {
+                fs::path prebuilt = compiler_path.parent_path() / "libbif.a";
+                library = fs::exists(prebuilt) ? prebuilt : cache.library(repo_root);
             }
-            continue;
-        }
-
-        auto assignment = split_assignment(stripped);
-        if (!assignment.first.empty() || !assignment.second.empty()) {
-            std::string name = assignment.first;
-            std::string expr = assignment.second;
-            name.erase(0, name.find_first_not_of(' '));
-            name.erase(name.find_last_not_of(' ') + 1);
-            expr.erase(0, expr.find_first_not_of(' '));
-            expr.erase(expr.find_last_not_of(' ') + 1);
-            if (!is_valid_identifier(name)) {
-                throw ParseError{"Line " + std::to_string(lineno) + ": Invalid variable name."};
+            std::vector<fs::path> objects;
+            if (!result.chunks.empty()) {
+                fs::path chunk_dir = outdir_path / (base_name + ".chunks");
+                int chunk_result = compile_chunks(result, chunk_dir, repo_root, flags, pch_header,
+                                                  options.use_cache ? &cache : nullptr, err, objects);
+                if (chunk_result != 0) {
+                    err << "Compilation failed." << std::endl;
+                    return 3;
+                }
             }
-            if (defined.find(name) == defined.end()) {
-                defined.insert(name);
-                out.push_back("auto " + name + " = " + normalize_expression(expr, imports, imported_names) + ";");
-            } else {
-                out.push_back(name + " = " + normalize_expression(expr, imports, imported_names) + ";");
+            // Fast builds link the plain code of the fat LTO objects instead.
+            if (!library.empty() && options.opt != OptLevel::Fast) {
+                flags.push_back("-flto");
+            }
+            int compile_result =
+                options.opt == OptLevel::Pgo
+                    ? compile_pgo(cache, key, flags, cpp_path, exe_path, repo_root, pch_header, library, pgo_sample,
+                                  log_path, err)
+                    : compile_cpp(flags, cpp_path, exe_path, repo_root, pch_header, library, log_path, objects);
+            forward_log();
+            if (compile_result != 0) {
+                err << "Compilation failed." << std::endl;
+                return 3;
+            }
+            if (options.use_cache) {
+                TraceScope trace("cache store");
+                cache.store(key, exe_path);
             }
-            continue;
         }
+        std::ofstream(key_path, std::ios::binary) << key;
+    }
+    return 0;
+}
 
-        out.push_back(normalize_expression(stripped, imports, imported_names) + ";");
+void set_env(const char* name, const std::string& value) {
+#ifdef _WIN32
+    _putenv_s(name, value.c_str());
+#else
+    if (value.empty()) {
+        unsetenv(name);
+    } else {
+        setenv(name, value.c_str(), 1);
     }
+#endif
+}
 
-    while (indent_stack.size() > 1) {
-        out.push_back("}");
-        indent_stack.pop_back();
+// The JSON reports of --profile and --mem-stats land next to the executable
+// (stem.profile.json, stem.mem.json) unless $BIF_PROFILE / $BIF_MEM_STATS
+// already name a file. Returns the variables it set.
+std::vector<const char*> set_report_env(const BuildOptions& options, const fs::path& exe_path) {
+    std::vector<const char*> reports;
+    if (options.profile && env_or_empty("BIF_PROFILE").empty()) {
+        set_env("BIF_PROFILE", fs::path(exe_path).replace_extension(".profile.json").string());
+        reports.push_back("BIF_PROFILE");
     }
+    if (options.mem_stats && env_or_empty("BIF_MEM_STATS").empty()) {
+        set_env("BIF_MEM_STATS", fs::path(exe_path).replace_extension(".mem.json").string());
+        reports.push_back("BIF_MEM_STATS");
+    }
+    return reports;
+}
 
-    return {out, imports};
+int run_program(const BuildOptions& options, const fs::path& exe_path) {
+    TraceScope trace("run");
+    std::vector<const char*> reports = set_report_env(options, exe_path);
+    int code = run_exe(exe_path);
+    for (const char* name : reports) {
+        set_env(name, "");
+    }
+    return code;
 }
 
-bool write_cpp(const fs::path& output_path, const std::vector<std::string>& body_lines, const std::vector<std::string>& imports) {
-    std::unordered_map<std::string, std::string> library_headers = {
-        {"BIFMath", "libs/BIFMath/BIFMath.h"},
-        {"BIFitertools", "libs/BIFitertools/BIFitertools.h"},
-        {"BIFtkinter", "libs/BIFtkinter/BIFtkinter.h"},
-    };
+// Runs the last program of a --run in place of bifc: the program inherits
+// bifc's process, so nothing stays behind waiting for it. Returns only if
+// the exec fails (or, on Windows, after running it as a child).
+int exec_program(const BuildOptions& options, const fs::path& exe_path) {
+#ifdef _WIN32
+    return run_program(options, exe_path);
+#else
+    // Under --trace bifc has to outlive the program to time it and write
+    // the trace.
+    if (Tracer::instance().enabled()) {
+        return run_program(options, exe_path);
+    }
+    set_report_env(options, exe_path);
+    std::cout.flush();
+    std::cerr.flush();
+    std::string path = exe_path.string();
+    char* argv[] = {const_cast<char*>(path.c_str()), nullptr};
+    execv(path.c_str(), argv);
+    std::cerr << "Cannot run " << path << ": " << std::strerror(errno) << std::endl;
+    return 127;
+#endif
+}
 
-    std::unordered_map<std::string, std::string> using_lines = {
-        {"BIFMath", "using bif::math::BIFMath;"},
-        {"BIFitertools", "using bif::itertools::BIFitertools;"},
-        {"BIFtkinter", "using bif::tkinter::BIFWindow;"},
-    };
+#ifndef _WIN32
+// --serve keeps one bifc process alive on a Unix domain socket so repeated
+// builds skip process start-up and reuse the warm file digests, compiler
+// lookup and library metadata. A request is "bifc-serve-v1", the client's
+// working directory and its build arguments, each NUL-terminated; the client
+// then shuts down its sending side. The reply is the exit code and the
+// executable path on one line each, followed by the diagnostics. Programs are
+// only built by the server; --run executes them in the client.
+const char* const kServeProtocol = "bifc-serve-v1";
 
-    std::vector<std::string> content = {
-        "#include <iostream>",
-        "#include <string>",
-        "#include <vector>",
-        "",
-    };
+// A client that sends nothing for this long is dropped, so idle or
+// half-open connections do not hold a worker.
+constexpr int kServeReadTimeoutSeconds = 30;
 
-    for (const auto& module_name : imports) {
-        auto it = library_headers.find(module_name);
-        if (it != library_headers.end()) {
-            content.push_back("#include \"" + it->second + "\"");
-        }
-    }
+fs::path default_socket_path() {
+    std::string path = env_or_empty("BIFC_SOCKET");
+    return path.empty() ? BuildCache::default_root() / "bifc.sock" : fs::path(path);
+}
 
-    content.push_back("");
-    for (const auto& module_name : imports) {
-        auto it = using_lines.find(module_name);
-        if (it != using_lines.end()) {
-            content.push_back(it->second);
-        }
+bool socket_address(const fs::path& path, sockaddr_un& address) {
+    std::string text = path.string();
+    if (text.size() >= sizeof(address.sun_path)) {
+        return false;
     }
+    address = sockaddr_un();
+    address.sun_family = AF_UNIX;
+    std::copy(text.begin(), text.end(), address.sun_path);
+    return true;
+}
 
-    content.insert(
-        content.end(),
-        {
-            "",
-            "std::string bif_input(const std::string& prompt) {",
-            "    if (!prompt.empty()) {",
-            "        std::cout << prompt;",
-            "    }",
-            "    std::string value;",
-            "    std::getline(std::cin, value);",
-            "    return value;",
-            "}",
-            "",
-            "int main() {",
-        });
-
-    for (const auto& line : body_lines) {
-        content.push_back("    " + line);
+int open_socket() {
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0) {
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
     }
-    content.push_back("    return 0;");
-    content.push_back("}");
+    return fd;
+}
 
-    std::ostringstream joined;
-    for (size_t i = 0; i < content.size(); ++i) {
-        joined << content[i] << "\n";
+int connect_socket(const fs::path& path) {
+    sockaddr_un address;
+    if (!socket_address(path, address)) {
+        return -1;
+    }
+    int fd = open_socket();
+    if (fd < 0) {
+        return -1;
     }
-    std::string new_content = joined.str();
+    if (::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
 
-    if (fs::exists(output_path)) {
-        std::ifstream in(output_path, std::ios::binary);
-        std::ostringstream current;
-        current << in.rdbuf();
-        if (current.str() == new_content) {
+bool read_all(int fd, std::string& out) {
+    char chunk[16 * 1024];
+    while (true) {
+        ssize_t count = ::read(fd, chunk, sizeof(chunk));
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
             return false;
         }
+        if (count == 0) {
+            return true;
+        }
+        out.append(chunk, static_cast<size_t>(count));
     }
+}
 
-    std::ofstream out(output_path, std::ios::binary);
-    out << new_content;
+bool write_all(int fd, std::string_view data) {
+    while (!data.empty()) {
+        ssize_t count = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data.remove_prefix(static_cast<size_t>(count));
+    }
     return true;
 }
 
-std::string quote_arg(const std::string& value) {
-    if (value.find(' ') == std::string::npos) {
-        return value;
+std::string serve_reply(int code, const fs::path& exe_path, const std::string& messages) {
+    return std::to_string(code) + "\n" + exe_path.string() + "\n" + messages;
+}
+
+std::string handle_serve_request(const std::string& request, const fs::path& compiler_path) {
+    std::vector<std::string> fields;
+    size_t start = 0;
+    while (start < request.size()) {
+        size_t end = request.find('\0', start);
+        if (end == std::string::npos) {
+            break;
+        }
+        fields.push_back(request.substr(start, end - start));
+        start = end + 1;
     }
-    return "\"" + value + "\"";
+    if (fields.size() < 2 || fields[0] != kServeProtocol || !fs::path(fields[1]).is_absolute()) {
+        return serve_reply(1, {}, "Malformed request.\n");
+    }
+
+    std::ostringstream err;
+    BuildOptions options;
+    if (!parse_build_options(std::vector<std::string>(fields.begin() + 2, fields.end()), options, err)) {
+        return serve_reply(1, {}, err.str());
+    }
+    if (options.inputs.size() != 1 || options.inputs[0] == "-" || options.interp || options.serve ||
+        options.connect) {
+        return serve_reply(1, {}, "Request is not supported by --serve.\n");
+    }
+    // Requests that write the same .cpp and executable run one at a time.
+    static std::mutex outputs_mutex;
+    static std::unordered_map<std::string, std::unique_ptr<std::mutex>> outputs;
+    std::string output =
+        (fs::path(fields[1]) / options.outdir / fs::path(options.inputs[0]).stem()).lexically_normal().string();
+    std::mutex* output_mutex;
+    {
+        std::lock_guard<std::mutex> lock(outputs_mutex);
+        std::unique_ptr<std::mutex>& entry = outputs[output];
+        if (!entry) {
+            entry = std::make_unique<std::mutex>();
+        }
+        output_mutex = entry.get();
+    }
+    std::lock_guard<std::mutex> output_lock(*output_mutex);
+    fs::path exe_path;
+    int code;
+    try {
+        code = build_program(options, options.inputs[0], fields[1], compiler_path, err, exe_path, true);
+    } catch (const std::exception& ex) {
+        err << ex.what() << std::endl;
+        code = 1;
+    }
+    return serve_reply(code, code == 0 ? exe_path : fs::path(), err.str());
 }
 
-int compile_cpp(const fs::path& cpp_path, const fs::path& exe_path, const fs::path& include_dir) {
-    std::string command =
-        "g++ -std=c++17 -O2 " + quote_arg(cpp_path.string()) +
-        " -I " + quote_arg(include_dir.string()) +
-        " -o " + quote_arg(exe_path.string());
+// SIGINT and SIGTERM shut the listening socket down, which wakes accept()
+// in run_server; it then finishes the queued requests and removes the
+// socket file.
+volatile std::sig_atomic_t serve_listener = -1;
+volatile std::sig_atomic_t serve_stopping = 0;
 
-    return std::system(command.c_str());
+extern "C" void stop_serving(int) {
+    serve_stopping = 1;
+    if (serve_listener >= 0) {
+        ::shutdown(serve_listener, SHUT_RDWR);
+    }
 }
 
-int run_exe(const fs::path& exe_path) {
-    std::string command = quote_arg(exe_path.string());
-    return std::system(command.c_str());
+int run_server(const fs::path& socket_path, const fs::path& compiler_path, unsigned jobs) {
+    sockaddr_un address;
+    if (!socket_address(socket_path, address)) {
+        std::cerr << "Socket path is too long: " << socket_path.string() << std::endl;
+        return 1;
+    }
+    int probe = connect_socket(socket_path);
+    if (probe >= 0) {
+        ::close(probe);
+        std::cerr << "A server is already listening on " << socket_path.string() << std::endl;
+        return 1;
+    }
+
+    std::error_code ec;
+    fs::create_directories(socket_path.parent_path(), ec);
+    ::unlink(socket_path.c_str());
+    int listener = open_socket();
+    if (listener < 0 || ::bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+        ::listen(listener, SOMAXCONN) != 0) {
+        std::cerr << "Cannot listen on " << socket_path.string() << ": " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+    serve_listener = listener;
+    struct sigaction action = {};
+    action.sa_handler = stop_serving;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<int> pending;
+    bool stopping = false;
+
+    std::vector<std::thread> workers;
+    unsigned worker_count = jobs ? jobs : std::max(1u, std::thread::hardware_concurrency());
+    JobSlots::compiler().set_limit(worker_count);
+    for (unsigned i = 0; i < worker_count; ++i) {
+        workers.emplace_back([&]() {
+            while (true) {
+                int client;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    ready.wait(lock, [&]() { return stopping || !pending.empty(); });
+                    if (pending.empty()) {
+                        return;
+                    }
+                    client = pending.front();
+                    pending.pop_front();
+                }
+                std::string request;
+                if (read_all(client, request)) {
+                    write_all(client, handle_serve_request(request, compiler_path));
+                }
+                ::close(client);
+            }
+        });
+    }
+
+    std::cerr << "bifc: serving on " << socket_path.string() << " with " << worker_count << " workers" << std::endl;
+    while (true) {
+        int client = ::accept(listener, nullptr, nullptr);
+        if (serve_stopping) {
+            if (client >= 0) {
+                ::close(client);
+            }
+            break;
+        }
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            std::cerr << "accept failed: " << std::strerror(errno) << std::endl;
+            break;
+        }
+        fcntl(client, F_SETFD, FD_CLOEXEC);
+        timeval timeout = {kServeReadTimeoutSeconds, 0};
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.push_back(client);
+        }
+        ready.notify_one();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    ready.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    serve_listener = -1;
+    ::close(listener);
+    ::unlink(socket_path.c_str());
+    if (serve_stopping) {
+        std::cerr << "bifc: server stopped" << std::endl;
+        return 0;
+    }
+    return 1;
 }
 
-std::string read_file_text(const fs::path& path) {
-    std::ifstream in(path, std::ios::binary);
-    if (!in) {
-        return "";
+// Sends the build to a running server. Returns false when none is listening,
+// so the caller can build in-process instead.
+bool request_build(
+    const fs::path& socket_path,
+    const fs::path& cwd,
+    const std::vector<std::string>& args,
+    int& code,
+    fs::path& exe_path,
+    std::string& messages) {
+    int fd = connect_socket(socket_path);
+    if (fd < 0) {
+        return false;
     }
-    std::ostringstream ss;
-    ss << in.rdbuf();
-    return ss.str();
+    std::string request = kServeProtocol;
+    request.push_back('\0');
+    request += cwd.string();
+    request.push_back('\0');
+    for (const auto& arg : args) {
+        request += arg;
+        request.push_back('\0');
+    }
+    std::string reply;
+    bool ok = write_all(fd, request) && ::shutdown(fd, SHUT_WR) == 0 && read_all(fd, reply);
+    ::close(fd);
+
+    size_t code_end = reply.find('\n');
+    size_t path_end = (code_end == std::string::npos) ? std::string::npos : reply.find('\n', code_end + 1);
+    if (!ok || path_end == std::string::npos) {
+        return false;
+    }
+    code = std::atoi(reply.substr(0, code_end).c_str());
+    exe_path = reply.substr(code_end + 1, path_end - code_end - 1);
+    messages = reply.substr(path_end + 1);
+    return true;
 }
+#endif
 
-int main(int argc, char** argv) {
-    std::string input_path;
-    std::string outdir = "build";
-    bool run = false;
+struct BuildOutcome {
+    int code = 0;
+    fs::path exe_path;
+    std::string messages;
+};
 
-    for (int i = 1; i < argc; ++i) {
-        std::string arg = argv[i];
-        if (arg == "--run") {
-            run = true;
-        } else if (arg == "--outdir") {
-            if (i + 1 >= argc) {
-                std::cerr << "Missing value for --outdir" << std::endl;
-                return 1;
-            }
-            outdir = argv[++i];
-        } else if (arg.rfind("-", 0) == 0) {
-            std::cerr << "Unknown option: " << arg << std::endl;
-            return 1;
-        } else if (input_path.empty()) {
-            input_path = arg;
-        } else {
-            std::cerr << "Unexpected argument: " << arg << std::endl;
-            return 1;
+// Builds one input through the --serve server when --connect finds one,
+// otherwise in-process.
+int build_input(
+    const BuildOptions& options,
+    const std::string& input_path,
+    const fs::path& cwd,
+    const fs::path& compiler_path,
+    std::ostream& err,
+    fs::path& exe_path,
+    bool capture_tool_output) {
+#ifndef _WIN32
+    if (options.connect && !options.interp && input_path != "-") {
+        std::vector<std::string> args = {input_path, "--outdir", options.outdir};
+        if (!options.use_cache) {
+            args.push_back("--no-cache");
+        }
+        if (!options.use_pch) {
+            args.push_back("--no-pch");
+        }
+        if (options.unbuffered) {
+            args.push_back("--unbuffered");
+        }
+        if (options.profile) {
+            args.push_back("--profile");
+        }
+        if (options.mem_stats) {
+            args.push_back("--mem-stats");
+        }
+        const char* const levels[] = {nullptr, "--opt=fast", "--opt=release", "--opt=pgo"};
+        if (options.opt != OptLevel::Default) {
+            args.push_back(levels[static_cast<int>(options.opt)]);
+        }
+        if (options.native) {
+            args.push_back("--native");
+        }
+        if (!options.pgo_input.empty()) {
+            args.insert(args.end(), {"--pgo-input", options.pgo_input});
+        }
+        int code = 0;
+        std::string messages;
+        fs::path socket_path = options.socket_path.empty() ? default_socket_path() : fs::path(options.socket_path);
+        TraceScope trace("build on server");
+        if (request_build(socket_path, cwd, args, code, exe_path, messages)) {
+            err << messages;
+            return code;
         }
     }
+#endif
+    return build_program(options, input_path, cwd, compiler_path, err, exe_path, capture_tool_output);
+}
 
-    if (input_path.empty()) {
-        std::cerr << "Input file not found." << std::endl;
-        return 1;
+// Builds every input on a pool of threads, at most `options.jobs` g++ at a
+// time. Diagnostics are buffered per input and printed in command-line
+// order, each line prefixed with its input, as soon as all earlier inputs
+// are done, so the output does not depend on scheduling.
+std::vector<BuildOutcome> build_batch(const BuildOptions& options, const fs::path& cwd, const fs::path& compiler_path) {
+    size_t count = options.inputs.size();
+    std::vector<BuildOutcome> outcomes(count);
+    std::vector<bool> done(count, false);
+    size_t reported = 0;
+    std::mutex mutex;
+    std::atomic<size_t> next{0};
+
+    unsigned jobs = options.jobs ? options.jobs : std::max(1u, std::thread::hardware_concurrency());
+    JobSlots::compiler().set_limit(jobs);
+
+    auto worker = [&]() {
+        while (true) {
+            size_t index = next++;
+            if (index >= count) {
+                return;
+            }
+            BuildOutcome& outcome = outcomes[index];
+            std::ostringstream err;
+            try {
+                outcome.code = build_input(options, options.inputs[index], cwd, compiler_path, err, outcome.exe_path, true);
+            } catch (const std::exception& ex) {
+                err << ex.what() << std::endl;
+                outcome.code = 1;
+            }
+            outcome.messages = err.str();
+
+            std::lock_guard<std::mutex> lock(mutex);
+            done[index] = true;
+            for (; reported < count && done[reported]; ++reported) {
+                std::istringstream lines(outcomes[reported].messages);
+                std::string line;
+                while (std::getline(lines, line)) {
+                    std::cerr << options.inputs[reported] << ": " << line << '\n';
+                }
+            }
+            std::cerr.flush();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    size_t thread_count = std::min<size_t>(count, std::max(jobs, std::thread::hardware_concurrency()));
+    for (size_t i = 1; i < thread_count; ++i) {
+        threads.emplace_back(worker);
     }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return outcomes;
+}
 
-    fs::path input = fs::absolute(input_path);
-    if (!fs::exists(input)) {
-        std::cerr << "Input file not found." << std::endl;
+#ifndef BIFC_NO_MAIN
+// Everything main() does once the options are parsed.
+int run_bifc(const BuildOptions& options, const fs::path& compiler_path) {
+    fs::path cwd = fs::current_path();
+
+    if (options.serve) {
+#ifndef _WIN32
+        return run_server(options.socket_path.empty() ? default_socket_path() : fs::path(options.socket_path),
+                          compiler_path, options.jobs);
+#else
+        std::cerr << "--serve is not supported on this platform." << std::endl;
         return 1;
+#endif
     }
 
-    std::ifstream in(input);
-    if (!in) {
+    if (options.inputs.empty()) {
         std::cerr << "Input file not found." << std::endl;
         return 1;
     }
 
-    std::vector<std::string> lines;
-    std::string line;
-    while (std::getline(in, line)) {
-        lines.push_back(line + "\n");
+    if (options.inputs.size() == 1 || options.interp) {
+        for (const auto& input : options.inputs) {
+            fs::path exe_path;
+            int code = build_input(options, input, cwd, compiler_path, std::cerr, exe_path, false);
+            if (code == 0 && options.run && !options.interp) {
+                code = exec_program(options, exe_path);
+            }
+            if (code != 0) {
+                return code;
+            }
+        }
+        return 0;
     }
 
-    TranspileResult result;
-    try {
-        result = transpile_bif(lines);
-    } catch (const ParseError& err) {
-        std::cerr << err.message << std::endl;
-        return 2;
+    std::unordered_map<std::string, std::string> outputs;
+    for (const auto& input : options.inputs) {
+        std::string stem = (input == "-") ? std::string("stdin") : fs::path(input).stem().string();
+        auto inserted = outputs.emplace(stem, input);
+        if (!inserted.second) {
+            std::cerr << "Inputs " << inserted.first->second << " and " << input << " would both build "
+                      << (fs::path(options.outdir) / (stem + ".exe")).string() << "." << std::endl;
+            return 1;
+        }
     }
 
-    fs::path outdir_path = fs::absolute(outdir);
-    fs::create_directories(outdir_path);
+    std::vector<BuildOutcome> outcomes = build_batch(options, cwd, compiler_path);
+    size_t failed = 0;
+    int first_error = 0;
+    for (const auto& outcome : outcomes) {
+        if (outcome.code != 0) {
+            ++failed;
+            first_error = first_error ? first_error : outcome.code;
+        }
+    }
+    if (failed) {
+        std::cerr << failed << " of " << outcomes.size() << " inputs failed." << std::endl;
+        return first_error;
+    }
 
-    std::string base_name = input.stem().string();
-    fs::path cpp_path = outdir_path / (base_name + ".cpp");
-    fs::path exe_path = outdir_path / (base_name + (".exe"));
-
-    bool cpp_changed = write_cpp(cpp_path, result.body, result.imports);
-
-    fs::path compiler_path = fs::absolute(argv[0]);
-    bool exe_up_to_date =
-        fs::exists(exe_path) &&
-        fs::exists(cpp_path) &&
-        fs::last_write_time(exe_path) >= fs::last_write_time(cpp_path) &&
-        fs::last_write_time(exe_path) >= fs::last_write_time(compiler_path);
-
-    if (cpp_changed || !exe_up_to_date) {
-        fs::path repo_root = compiler_path.parent_path().parent_path();
-        int compile_result = compile_cpp(cpp_path, exe_path, repo_root);
-        if (compile_result != 0) {
-            std::cerr << "Compilation failed." << std::endl;
-            return 3;
+    if (options.run) {
+        for (const auto& outcome : outcomes) {
+            bool last = &outcome == &outcomes.back();
+            int code = last ? exec_program(options, outcome.exe_path) : run_program(options, outcome.exe_path);
+            if (code != 0) {
+                return code;
+            }
         }
     }
+    return 0;
+}
 
-    if (run) {
-        return run_exe(exe_path);
+int main(int argc, char** argv) {
+    BuildOptions options;
+    if (!parse_build_options(std::vector<std::string>(argv + 1, argv + argc), options, std::cerr)) {
+        return 1;
     }
 
-    return 0;
+    bool tracing = !options.trace_path.empty() || options.time_phases;
+    if (tracing) {
+        Tracer::instance().enable();
+    }
+    int code = run_bifc(options, fs::absolute(argv[0]));
+    if (tracing) {
+        if (options.time_phases) {
+            Tracer::instance().print_summary(std::cerr);
+        }
+        if (!options.trace_path.empty() && !Tracer::instance().write_chrome_trace(options.trace_path)) {
+            std::cerr << "Cannot write trace to " << options.trace_path << std::endl;
+        }
+    }
+    return code;
 }
+#endif // BIFC_NO_MAIN